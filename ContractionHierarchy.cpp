@@ -0,0 +1,495 @@
+#include "ContractionHierarchy.h"
+#include "IndexedHeap.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+// witness searches give up after settling this many nodes and add the shortcut
+// instead; a few unnecessary shortcuts are cheaper than exhaustive searches
+static const unsigned int WITNESS_SETTLE_LIMIT = 1000;
+
+// Working state while the hierarchy is built: the graph that is still left,
+// with shortcuts added as nodes are contracted out of it.
+class HierarchyBuilder
+{
+public:
+	  // one edge of the shrinking graph, listed at both of its ends
+	struct Arc {
+		unsigned int to;
+		double weight;
+		unsigned int edge; // index into edges
+	};
+
+	  // An undirected edge that will become one upward arc. For an original edge,
+	  // graphEdge is the street edge; for a shortcut between ends[0] and ends[1],
+	  // halves[i] is the edge joining the contracted middle node to ends[i].
+	struct Edge {
+		unsigned int ends[2];
+		double weight;
+		unsigned int graphEdge;
+		unsigned int halves[2];
+		unsigned int lower; // the end contracted first; set when that happens
+	};
+
+	HierarchyBuilder(const StreetGraph& g);
+	void contractAll();
+
+	vector<Edge> edges;
+	vector<vector<Arc> > up; // arcs left at each node when it was contracted
+
+private:
+	unsigned int processNode(unsigned int x, bool addShortcuts);
+	void witnessSearch(unsigned int source, unsigned int skip, double limit);
+	void addShortcut(unsigned int u, unsigned int w, double weight, unsigned int viaU, unsigned int viaW);
+	Arc* findArc(unsigned int from, unsigned int to);
+	double priority(unsigned int x);
+
+	unsigned int numNodes;
+	vector<vector<Arc> > adj;
+	vector<unsigned int> contractedNeighbors;
+	SearchWorkspace ws;
+};
+
+HierarchyBuilder::HierarchyBuilder(const StreetGraph& g) {
+	numNodes = g.numNodes();
+	adj.resize(numNodes);
+	up.resize(numNodes);
+	contractedNeighbors.assign(numNodes, 0);
+	for (unsigned int u = 0; u < numNodes; u++) { // keep the shortest street between each pair of nodes
+		for (const StreetEdge& e : g.edgesFrom(u)) {
+			if (e.to == u) {
+				continue;
+			}
+			Arc* a = findArc(u, e.to);
+			if (a != nullptr) {
+				if (e.length < a->weight) {
+					Edge& existing = edges[a->edge];
+					existing.weight = e.length;
+					existing.graphEdge = g.edgeIndex(e);
+					a->weight = e.length;
+					findArc(e.to, u)->weight = e.length;
+				}
+				continue;
+			}
+			Edge n;
+			n.ends[0] = u;
+			n.ends[1] = e.to;
+			n.weight = e.length;
+			n.graphEdge = g.edgeIndex(e);
+			n.halves[0] = n.halves[1] = StreetGraph::NO_NODE;
+			n.lower = StreetGraph::NO_NODE;
+			edges.push_back(n);
+			Arc a1 = { e.to, e.length, (unsigned int)edges.size() - 1 };
+			Arc a2 = { u, e.length, (unsigned int)edges.size() - 1 };
+			adj[u].push_back(a1);
+			adj[e.to].push_back(a2);
+		}
+	}
+}
+
+HierarchyBuilder::Arc* HierarchyBuilder::findArc(unsigned int from, unsigned int to) {
+	for (Arc& a : adj[from]) {
+		if (a.to == to) {
+			return &a;
+		}
+	}
+	return nullptr;
+}
+
+void HierarchyBuilder::witnessSearch(unsigned int source, unsigned int skip, double limit) {
+	// bounded Dijkstra from source through the remaining graph, avoiding skip
+	ws.reset(numNodes);
+	IndexedHeap<4>& open = ws.openList();
+	ws.label(source, 0, nullptr);
+	open.push(source, 0);
+	unsigned int settled = 0;
+	while (!open.empty() && open.topKey() <= limit && settled < WITNESS_SETTLE_LIMIT) {
+		unsigned int v = open.pop();
+		ws.close(v);
+		settled++;
+		double gv = ws.g(v);
+		for (const Arc& a : adj[v]) {
+			if (a.to == skip || ws.closed(a.to)) {
+				continue;
+			}
+			double gNew = gv + a.weight;
+			if (gNew < ws.g(a.to)) {
+				ws.label(a.to, gNew, nullptr);
+				open.pushOrDecrease(a.to, gNew);
+			}
+		}
+	}
+}
+
+unsigned int HierarchyBuilder::processNode(unsigned int x, bool addShortcuts) {
+	// for each pair of x's neighbours, a shortcut is needed unless some path
+	// avoiding x is at least as short as the one through it
+	vector<Arc> neighbours = adj[x];
+	unsigned int shortcuts = 0;
+	for (unsigned int i = 0; i + 1 < neighbours.size(); i++) {
+		double limit = 0;
+		for (unsigned int j = i + 1; j < neighbours.size(); j++) {
+			limit = max(limit, neighbours[i].weight + neighbours[j].weight);
+		}
+		witnessSearch(neighbours[i].to, x, limit);
+		for (unsigned int j = i + 1; j < neighbours.size(); j++) {
+			double via = neighbours[i].weight + neighbours[j].weight;
+			if (ws.g(neighbours[j].to) <= via) {
+				continue; // witness found
+			}
+			shortcuts++;
+			if (addShortcuts) {
+				addShortcut(neighbours[i].to, neighbours[j].to, via, neighbours[i].edge, neighbours[j].edge);
+			}
+		}
+	}
+	return shortcuts;
+}
+
+void HierarchyBuilder::addShortcut(unsigned int u, unsigned int w, double weight, unsigned int viaU, unsigned int viaW) {
+	Arc* existing = findArc(u, w);
+	if (existing != nullptr && existing->weight <= weight) {
+		return;
+	}
+	Edge n;
+	n.ends[0] = u;
+	n.ends[1] = w;
+	n.weight = weight;
+	n.graphEdge = StreetGraph::NO_NODE;
+	n.halves[0] = viaU;
+	n.halves[1] = viaW;
+	n.lower = StreetGraph::NO_NODE;
+	edges.push_back(n);
+	unsigned int id = (unsigned int)edges.size() - 1;
+	if (existing != nullptr) { // the shortcut beats the direct edge, so it takes its place
+		existing->weight = weight;
+		existing->edge = id;
+		Arc* back = findArc(w, u);
+		back->weight = weight;
+		back->edge = id;
+		return;
+	}
+	Arc a1 = { w, weight, id };
+	Arc a2 = { u, weight, id };
+	adj[u].push_back(a1);
+	adj[w].push_back(a2);
+}
+
+double HierarchyBuilder::priority(unsigned int x) {
+	// edge difference, nudged toward spreading contractions evenly over the map
+	return (double)processNode(x, false) - (double)adj[x].size() + contractedNeighbors[x];
+}
+
+void HierarchyBuilder::contractAll() {
+	IndexedHeap<4> queue;
+	queue.resize(numNodes);
+	for (unsigned int x = 0; x < numNodes; x++) {
+		queue.push(x, priority(x));
+	}
+	while (!queue.empty()) {
+		unsigned int x = queue.pop();
+		double p = priority(x); // lazy update: contracting others may have changed it
+		if (!queue.empty() && p > queue.topKey()) {
+			queue.push(x, p);
+			continue;
+		}
+
+		processNode(x, true);
+		up[x] = adj[x];
+		for (const Arc& a : adj[x]) { // x leaves the graph; its remaining edges point upward
+			edges[a.edge].lower = x;
+			vector<Arc>& other = adj[a.to];
+			for (unsigned int i = 0; i < other.size(); i++) {
+				if (other[i].to == x) {
+					other[i] = other.back();
+					other.pop_back();
+					break;
+				}
+			}
+			contractedNeighbors[a.to]++;
+		}
+		vector<Arc>().swap(adj[x]);
+		for (const Arc& a : up[x]) {
+			if (queue.contains(a.to)) {
+				queue.changeKey(a.to, priority(a.to));
+			}
+		}
+	}
+}
+
+//******************** ContractionHierarchy functions *************************
+
+const unsigned int ContractionHierarchy::NO_ARC;
+
+ContractionHierarchy::ContractionHierarchy() {
+	clear();
+}
+
+void ContractionHierarchy::clear() {
+	m_graph = nullptr;
+	m_ownedOffsets.clear();
+	m_ownedArcs.clear();
+	m_ownedUnpack.clear();
+	bind();
+}
+
+void ContractionHierarchy::bind() {
+	m_numNodes = m_ownedOffsets.empty() ? 0 : (unsigned int)m_ownedOffsets.size() - 1;
+	m_numArcs = (unsigned int)m_ownedArcs.size();
+	m_offsets = m_ownedOffsets.data();
+	m_arcs = m_ownedArcs.data();
+	m_unpack = m_ownedUnpack.data();
+}
+
+void ContractionHierarchy::build(const StreetGraph& g) {
+	clear();
+	HierarchyBuilder builder(g);
+	builder.contractAll();
+
+	// lay the upward arcs out as CSR, then translate edge ids into arc indices
+	unsigned int numNodes = g.numNodes();
+	vector<unsigned int> arcOf(builder.edges.size(), NO_ARC);
+	m_ownedOffsets.assign(numNodes + 1, 0);
+	for (unsigned int x = 0; x < numNodes; x++) {
+		m_ownedOffsets[x + 1] = m_ownedOffsets[x] + (unsigned int)builder.up[x].size();
+		for (const HierarchyBuilder::Arc& a : builder.up[x]) {
+			arcOf[a.edge] = (unsigned int)m_ownedArcs.size();
+			StreetEdge arc = StreetEdge();
+			arc.from = x;
+			arc.to = a.to;
+			arc.length = a.weight;
+			m_ownedArcs.push_back(arc);
+		}
+	}
+	m_ownedUnpack.resize(m_ownedArcs.size());
+	for (unsigned int x = 0; x < numNodes; x++) {
+		for (const HierarchyBuilder::Arc& a : builder.up[x]) {
+			const HierarchyBuilder::Edge& e = builder.edges[a.edge];
+			Unpack& u = m_ownedUnpack[arcOf[a.edge]];
+			if (e.graphEdge != StreetGraph::NO_NODE) {
+				u.first = e.graphEdge;
+				u.second = NO_ARC;
+			}
+			else { // first joins the middle to this arc's lower end, second to its upper end
+				int lowerEnd = (e.ends[0] == x) ? 0 : 1;
+				u.first = arcOf[e.halves[lowerEnd]];
+				u.second = arcOf[e.halves[1 - lowerEnd]];
+			}
+		}
+	}
+	m_graph = &g;
+	bind();
+}
+
+bool ContractionHierarchy::attach(const StreetGraph& g) {
+	clear();
+	SnapshotSection offsets, arcs, unpack;
+	if (!g.findSnapshotSection(SECTION_CH_OFFSETS, offsets) || !g.findSnapshotSection(SECTION_CH_ARCS, arcs) ||
+		!g.findSnapshotSection(SECTION_CH_UNPACK, unpack)) {
+		return false;
+	}
+	unsigned int numArcs = (unsigned int)(arcs.size / sizeof(StreetEdge));
+	const unsigned int* offsetData = reinterpret_cast<const unsigned int*>(offsets.data);
+	if (offsets.size != (g.numNodes() + 1ull) * sizeof(unsigned int) || arcs.size != numArcs * sizeof(StreetEdge) ||
+		unpack.size != numArcs * sizeof(Unpack) || offsetData[g.numNodes()] != numArcs) {
+		return false;
+	}
+	m_graph = &g;
+	m_numNodes = g.numNodes();
+	m_numArcs = numArcs;
+	m_offsets = offsetData;
+	m_arcs = reinterpret_cast<const StreetEdge*>(arcs.data);
+	m_unpack = reinterpret_cast<const Unpack*>(unpack.data);
+	if (!validate()) {
+		std::cerr << "The map snapshot's contraction hierarchy is corrupt; routing without it" << endl;
+		clear();
+		return false;
+	}
+	return true;
+}
+
+bool ContractionHierarchy::validate() const {
+	// upward arcs: CSR runs from 0 to the arc count, each arc leaving its own node
+	// for another real node
+	if (m_offsets[0] != 0) {
+		return false;
+	}
+	vector<unsigned int> inDegree(m_numNodes, 0);
+	for (unsigned int x = 0; x < m_numNodes; x++) {
+		if (m_offsets[x + 1] < m_offsets[x] || m_offsets[x + 1] > m_numArcs) {
+			return false;
+		}
+		for (unsigned int a = m_offsets[x]; a < m_offsets[x + 1]; a++) {
+			const StreetEdge& arc = m_arcs[a];
+			if (arc.from != x || arc.to >= m_numNodes || arc.to == x || !(arc.length >= 0 && std::isfinite(arc.length))) {
+				return false;
+			}
+			inDegree[arc.to]++;
+		}
+	}
+	// the arcs must climb a ranking: repeatedly peel off nodes nothing points up
+	// to, and every node must go, or some arcs form a cycle
+	vector<unsigned int> ready;
+	for (unsigned int x = 0; x < m_numNodes; x++) {
+		if (inDegree[x] == 0) {
+			ready.push_back(x);
+		}
+	}
+	unsigned int ranked = 0;
+	while (!ready.empty()) {
+		unsigned int x = ready.back();
+		ready.pop_back();
+		ranked++;
+		for (unsigned int a = m_offsets[x]; a < m_offsets[x + 1]; a++) {
+			if (--inDegree[m_arcs[a].to] == 0) {
+				ready.push_back(m_arcs[a].to);
+			}
+		}
+	}
+	if (ranked != m_numNodes) {
+		return false;
+	}
+	// unpacking: an original edge joins the arc's two ends (and can be walked
+	// either way); a shortcut's two halves leave one middle node for the arc's
+	// lower and upper ends. Halves start lower than the arc, so unpacking ends.
+	for (unsigned int a = 0; a < m_numArcs; a++) {
+		const StreetEdge& arc = m_arcs[a];
+		const Unpack& u = m_unpack[a];
+		if (u.second == NO_ARC) {
+			if (u.first >= m_graph->numEdges()) {
+				return false;
+			}
+			const StreetEdge& e = m_graph->edge(u.first);
+			bool joins = (e.from == arc.from && e.to == arc.to) || (e.from == arc.to && e.to == arc.from);
+			if (!joins || m_graph->reverseOf(e) == nullptr) {
+				return false;
+			}
+		}
+		else if (u.first >= m_numArcs || u.second >= m_numArcs || m_arcs[u.first].from != m_arcs[u.second].from ||
+		         m_arcs[u.first].to != arc.from || m_arcs[u.second].to != arc.to) {
+			return false;
+		}
+	}
+	return true;
+}
+
+vector<SnapshotSection> ContractionHierarchy::snapshotSections() const {
+	vector<SnapshotSection> sections;
+	if (empty()) {
+		return sections;
+	}
+	SnapshotSection s;
+	s.id = SECTION_CH_OFFSETS;
+	s.data = reinterpret_cast<const char*>(m_offsets);
+	s.size = (m_numNodes + 1) * sizeof(unsigned int);
+	sections.push_back(s);
+	s.id = SECTION_CH_ARCS;
+	s.data = reinterpret_cast<const char*>(m_arcs);
+	s.size = m_numArcs * sizeof(StreetEdge);
+	sections.push_back(s);
+	s.id = SECTION_CH_UNPACK;
+	s.data = reinterpret_cast<const char*>(m_unpack);
+	s.size = m_numArcs * sizeof(Unpack);
+	sections.push_back(s);
+	return sections;
+}
+
+bool ContractionHierarchy::findPath(unsigned int startNode, unsigned int endNode, vector<const StreetEdge*>& path, SearchWorkspace& ws) const {
+	path.clear();
+	if (startNode == endNode) {
+		return true;
+	}
+
+	// upward Dijkstra from both ends; a side stops once its smallest key can't
+	// improve on the best meeting point found so far
+	SearchWorkspace* side[2] = { &ws, &ws.reverse() };
+	unsigned int origin[2] = { startNode, endNode };
+	for (int d = 0; d < 2; d++) {
+		side[d]->reset(m_numNodes);
+		side[d]->label(origin[d], 0, nullptr);
+		side[d]->openList().push(origin[d], 0);
+	}
+	double best = numeric_limits<double>::infinity();
+	unsigned int meet = StreetGraph::NO_NODE;
+	for (;;) {
+		bool live[2];
+		for (int d = 0; d < 2; d++) {
+			live[d] = !side[d]->openList().empty() && side[d]->openList().topKey() < best;
+		}
+		if (!live[0] && !live[1]) {
+			break;
+		}
+		int d = (!live[1] || (live[0] && side[0]->openList().topKey() <= side[1]->openList().topKey())) ? 0 : 1;
+		SearchWorkspace& here = *side[d];
+		SearchWorkspace& there = *side[1 - d];
+		unsigned int q = here.openList().pop();
+		here.close(q);
+		double gq = here.g(q);
+		if (gq + there.g(q) < best) {
+			best = gq + there.g(q);
+			meet = q;
+		}
+		for (const StreetEdge* arc = m_arcs + m_offsets[q]; arc != m_arcs + m_offsets[q + 1]; arc++) {
+			unsigned int succ = arc->to;
+			double gNew = gq + arc->length;
+			if (!here.closed(succ) && gNew < here.g(succ)) {
+				here.label(succ, gNew, arc);
+				here.openList().pushOrDecrease(succ, gNew);
+				if (gNew + there.g(succ) < best) {
+					best = gNew + there.g(succ);
+					meet = succ;
+				}
+			}
+		}
+	}
+	if (meet == StreetGraph::NO_NODE) {
+		return false;
+	}
+
+	// climb back down both sides, unpacking every arc into street edges
+	vector<const StreetEdge*> climb;
+	for (unsigned int curr = meet; curr != startNode; curr = side[0]->parent(curr)->from) {
+		climb.push_back(side[0]->parent(curr));
+	}
+	for (unsigned int i = (unsigned int)climb.size(); i-- > 0; ) {
+		unpack((unsigned int)(climb[i] - m_arcs), true, path);
+	}
+	for (unsigned int curr = meet; curr != endNode; curr = side[1]->parent(curr)->from) {
+		unpack((unsigned int)(side[1]->parent(curr) - m_arcs), false, path);
+	}
+	return true;
+}
+
+void ContractionHierarchy::unpack(unsigned int arc, bool forward, vector<const StreetEdge*>& path) const {
+	// depth-first with an explicit stack, so deep shortcut nesting can't overflow the call stack
+	vector<pair<unsigned int, bool> > stack;
+	stack.push_back(make_pair(arc, forward));
+	while (!stack.empty()) {
+		unsigned int a = stack.back().first;
+		bool fwd = stack.back().second; // travelling from the arc's lower end to its upper end
+		stack.pop_back();
+		const Unpack& u = m_unpack[a];
+		if (u.second == NO_ARC) { // an original street edge
+			const StreetEdge* e = &m_graph->edge(u.first);
+			unsigned int travelFrom = fwd ? m_arcs[a].from : m_arcs[a].to;
+			if (e->from != travelFrom) {
+				e = m_graph->reverseOf(*e);
+			}
+			path.push_back(e);
+			continue;
+		}
+		// lower -> middle runs first backwards, then middle -> upper runs second forwards;
+		// pushed in reverse so they pop in travel order
+		if (fwd) {
+			stack.push_back(make_pair(u.second, true));
+			stack.push_back(make_pair(u.first, false));
+		}
+		else {
+			stack.push_back(make_pair(u.first, true));
+			stack.push_back(make_pair(u.second, false));
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef CONTRACTIONHIERARCHY_INCLUDED
+#define CONTRACTIONHIERARCHY_INCLUDED
+
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include <vector>
+
+// Snapshot sections that hold a hierarchy next to the map it was built from
+enum ContractionHierarchySection
+{
+	SECTION_CH_OFFSETS = 16, SECTION_CH_ARCS, SECTION_CH_UNPACK
+};
+
+// A contraction hierarchy over a StreetGraph. Preprocessing contracts nodes one
+// at a time, least important first (by edge difference: shortcuts needed minus
+// edges removed, plus how many neighbours are already gone), and adds a shortcut
+// between two neighbours of the contracted node only when a bounded witness
+// search finds no other path as short. A query is then a bidirectional Dijkstra
+// that only ever climbs to higher-ranked nodes, which settles a tiny fraction of
+// the graph. Shortcuts remember the two arcs they replace, so a route unpacks
+// back into the original street edges.
+//
+// The road graph is symmetric, so one upward adjacency serves both search
+// directions: node n's arcs run to its higher-ranked neighbours. Arcs are stored
+// as StreetEdges (from = lower node, to = higher node, length = weight, nameId
+// unused) so SearchWorkspace can keep them as parents.
+class ContractionHierarchy
+{
+public:
+	ContractionHierarchy();
+	void clear();
+	bool empty() const { return m_numNodes == 0; }
+
+	  // preprocess g; the hierarchy refers to g's edges, so g must outlive it
+	void build(const StreetGraph& g);
+	  // use a hierarchy stored in g's snapshot in place; false (and empty) if there
+	  // isn't one or it doesn't fit g
+	bool attach(const StreetGraph& g);
+	  // the sections to store in a snapshot to get this hierarchy back with attach()
+	std::vector<SnapshotSection> snapshotSections() const;
+
+	  // shortest path between two nodes as original graph edges, in travel order
+	bool findPath(unsigned int startNode, unsigned int endNode, std::vector<const StreetEdge*>& path, SearchWorkspace& ws) const;
+
+	unsigned int numArcs() const { return m_numArcs; }
+
+	  // We prevent a ContractionHierarchy object from being copied or assigned.
+	ContractionHierarchy(const ContractionHierarchy&) = delete;
+	ContractionHierarchy& operator=(const ContractionHierarchy&) = delete;
+
+private:
+	  // how to expand an arc: an original edge (graph edge index in first, second
+	  // NO_ARC) or a shortcut made of two arcs that both leave the contracted middle node
+	struct Unpack {
+		unsigned int first;
+		unsigned int second;
+	};
+	static const unsigned int NO_ARC = 0xFFFFFFFFu;
+
+	void bind();
+	  // check that attached arrays describe a hierarchy over m_graph, so that
+	  // queries stay inside them and every shortcut unpacks in finitely many steps
+	bool validate() const;
+	void unpack(unsigned int arc, bool forward, std::vector<const StreetEdge*>& path) const;
+
+	const StreetGraph* m_graph;
+	std::vector<unsigned int> m_ownedOffsets;
+	std::vector<StreetEdge> m_ownedArcs;
+	std::vector<Unpack> m_ownedUnpack;
+
+	  // views over either the owned arrays or a mapped snapshot
+	unsigned int m_numNodes;
+	unsigned int m_numArcs;
+	const unsigned int* m_offsets;
+	const StreetEdge* m_arcs;
+	const Unpack* m_unpack;
+};
+
+#endif // CONTRACTIONHIERARCHY_INCLUDED
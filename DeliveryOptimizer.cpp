@@ -1,6 +1,18 @@
 #include "provided.h"
 #include "ExpandableHashMap.h"
+#include "DistanceMatrix.h"
+#include "FastRandom.h"
+#include "TourLocalSearch.h"
+#include "HeldKarp.h"
+#include "LargeTour.h"
+#include "SearchBudget.h"
+#include "StreetGraph.h"
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <memory>
 using namespace std;
 
 class DeliveryOptimizerImpl
@@ -13,8 +25,36 @@ public:
         vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+    void optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        const DistanceMatrix& costs,
+        double& oldDistance,
+        double& newDistance) const;
+    void setOptions(const OptimizerOptions& opts) { options = opts; }
+    OptimizerStats lastStats() const { return stats; }
 private:
+	  // the matrix search under budget, handing large manifests on to optimizeLarge
+	void optimizeWithMatrix(
+	    vector<DeliveryRequest>& deliveries,
+	    const GeoCoord& depot,
+	    const DistanceMatrix& costs,
+	    SearchBudget& budget,
+	    double& oldDistance,
+	    double& newDistance) const;
+	  // the cluster-based search for manifests over options.largeStops (see LargeTour.h)
+	void optimizeLarge(
+	    const GeoCoord& depot,
+	    vector<DeliveryRequest>& deliveries,
+	    const PointCosts& costs,
+	    SearchBudget& budget,
+	    double& oldDistance,
+	    double& newDistance) const;
+	void recordStats(const SearchBudget& budget) const;
+
 	const StreetMap* streetMap;
+	OptimizerOptions options;
+	mutable OptimizerStats stats;
 };
 
 DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm)
@@ -26,71 +66,280 @@ DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
 {
 }
 
-void getDistance(GeoCoord depot, vector<DeliveryRequest> deliveries, double& distance) {
-	distance = 0;
-	GeoCoord prevCoord = depot;
-	auto it = deliveries.begin();
-	while (it != deliveries.end()) { // add up all distances to find the old crow's distance
-		GeoCoord nextCoord = (*it).location;
-		distance += distanceEarthMiles(prevCoord, nextCoord);
-		prevCoord = nextCoord;
-		it++;
+  // length of the tour that leaves the depot (point 0 of costs), visits the
+  // points in order and comes back
+static double tourLength(const vector<unsigned int>& order, const DistanceMatrix& costs) {
+	double distance = 0;
+	unsigned int prev = 0;
+	for (unsigned int p : order) { // add up all distances to find the tour's length
+		distance += costs(prev, p);
+		prev = p;
 	}
-	distance += distanceEarthMiles(prevCoord, depot);
+	return distance + costs(prev, 0);
 }
 
-void DeliveryOptimizerImpl::optimizeDeliveryOrder(
-    const GeoCoord& depot,
-    vector<DeliveryRequest>& deliveries,
-    double& oldCrowDistance,
-    double& newCrowDistance) const { // simulated annealing optimization algorithm
-	oldCrowDistance = 0;
-	newCrowDistance = 0;
-	
-	getDistance(depot, deliveries, oldCrowDistance);
-	newCrowDistance = oldCrowDistance;
-
-	double temp = 0.5; // set "temperature" to 0.5, decrease exponentially by 0.9x every iteration
-	bool changed = false;
-	for (int k = 0; k < 25; k++) {
-		changed = false;
-		for (unsigned int i = 0, numChanges = 0; i <= 100 * deliveries.size() && numChanges <= 10; i++) { // make this many random changes
-			int transportOrReverse = rand() % 2; // randomly decide whether to reverse or transport part of the map
-			unsigned int startPath = rand() % deliveries.size(); // randomly pick start of section to transform
-			unsigned int endPath = rand() % (deliveries.size() - startPath) + startPath; // randomly pick end of section to transform
+  // Change in tour length from reversing order[first..last). Costs are symmetric,
+  // so only the two edges at the ends of the section change.
+static double reverseDelta(const vector<unsigned int>& order, unsigned int first, unsigned int last, const DistanceMatrix& costs) {
+	if (last - first < 2) {
+		return 0;
+	}
+	unsigned int prev = (first == 0) ? 0 : order[first - 1];
+	unsigned int next = (last == order.size()) ? 0 : order[last];
+	unsigned int a = order[first];
+	unsigned int b = order[last - 1];
+	return costs(prev, b) + costs(a, next) - costs(prev, a) - costs(b, next);
+}
 
-			vector<DeliveryRequest> tempDeliveries = deliveries;
+  // Change in tour length from moving order[first..last] to the end of the tour,
+  // just before the return to the depot: three edges out, three edges in.
+static double transportDelta(const vector<unsigned int>& order, unsigned int first, unsigned int last, const DistanceMatrix& costs) {
+	if (last + 1 == order.size()) {
+		return 0; // already at the end
+	}
+	unsigned int prev = (first == 0) ? 0 : order[first - 1];
+	unsigned int a = order[first];
+	unsigned int b = order[last];
+	unsigned int next = order[last + 1];
+	unsigned int tail = order.back();
+	return costs(prev, next) + costs(tail, a) + costs(b, 0) - costs(prev, a) - costs(b, next) - costs(tail, 0);
+}
 
-			if (transportOrReverse == 0) { // reverse segment
-				reverse(tempDeliveries.begin() + startPath, tempDeliveries.begin() + endPath);
-			}
-			else {
-				for (unsigned int j = startPath; j <= endPath; j++) { // transport segment to end
-					DeliveryRequest temp = tempDeliveries[j];
-					tempDeliveries.erase(tempDeliveries.begin() + j);
-					tempDeliveries.push_back(temp);
+  // One simulated annealing chain over the visiting order; order holds matrix
+  // points 1..n. Each candidate move is scored in constant time from the few
+  // edges it changes, and only applied to the order when it is accepted. Leaves
+  // the shortest order it passed through in order and returns its length, also
+  // when the budget runs out part way.
+static double anneal(vector<unsigned int>& order, const DistanceMatrix& costs, const OptimizerOptions& options, FastRandom& random,
+                     SearchBudget& budget) {
+	if (order.empty() || budget.exhausted()) {
+		return tourLength(order, costs);
+	}
+	vector<unsigned int> best = order;
+	double bestDistance = tourLength(order, costs);
+	double currDistance = bestDistance;
+
+	double temp = options.startTemperature; // decreases exponentially every round
+	bool changed = false;
+	bool outOfBudget = false;
+	unsigned int uncharged = 0; // evaluations not yet charged to the budget
+	for (unsigned int k = 0; k < options.rounds && !outOfBudget; k++) {
+		changed = false;
+		for (unsigned int i = 0, numChanges = 0; i <= options.movesPerStop * order.size() && numChanges <= options.changesPerRound; i++) { // make this many random changes
+			if (++uncharged == BUDGET_BATCH) {
+				uncharged = 0;
+				if (budget.charge(BUDGET_BATCH)) {
+					outOfBudget = true;
+					break;
 				}
 			}
+			bool reverseMove = random.below(2) == 0; // randomly decide whether to reverse or transport part of the map
+			unsigned int startPath = random.below((unsigned int)order.size()); // randomly pick start of section to transform
+			unsigned int endPath = random.below((unsigned int)order.size() - startPath) + startPath; // randomly pick end of section to transform
 
-			getDistance(depot, tempDeliveries, newCrowDistance);
+			double delta = reverseMove ? reverseDelta(order, startPath, endPath, costs)
+			                           : transportDelta(order, startPath, endPath, costs);
 
-			int randInt = rand() % 100;
-			double r = double(randInt) / 100.0;
 			// determine whether to actually do the transformation (if distance decreases or fxn is less than random [0, 1)
-			if (newCrowDistance < oldCrowDistance || exp(-(newCrowDistance - oldCrowDistance) / temp) > r) {
-				deliveries = tempDeliveries;
+			if (delta < 0 || exp(-delta / temp) > random.uniform()) {
+				if (reverseMove) { // reverse segment
+					reverse(order.begin() + startPath, order.begin() + endPath);
+				}
+				else { // transport segment to end
+					rotate(order.begin() + startPath, order.begin() + endPath + 1, order.end());
+				}
+				currDistance += delta;
+				if (currDistance < bestDistance) {
+					best = order;
+					bestDistance = currDistance;
+				}
 				numChanges++;
 				changed = true;
 			}
-			else {
-				newCrowDistance = oldCrowDistance; // no changes made
-			}
 		}
-		temp = temp * 0.9; // exponentially decrease temperature
+		temp = temp * options.cooling; // exponentially decrease temperature
 		if (changed == false) {
-			k = 30; // end the loop, no changes were made in the last iteration
+			break; // no changes were made in the last round
 		}
 	}
+	budget.charge(uncharged);
+	order.swap(best);
+	return tourLength(order, costs); // summed afresh so rounding in the deltas doesn't build up
+}
+
+  // Run options.numChains chains from the same starting order, handing chains to
+  // the threads one at a time, and keep the shortest result (the lowest chain on
+  // ties, so the answer doesn't depend on which thread finished first). Local
+  // search, if asked for, polishes each chain's tour, or is all there is. Small
+  // enough tours skip all that and are solved exactly. Each chain gets an equal
+  // share of the budget's evaluations, the shares adding up to its limit.
+static void optimizeOrder(vector<unsigned int>& order, const DistanceMatrix& costs, const OptimizerOptions& options,
+                          SearchBudget& budget, double& oldDistance, double& newDistance) {
+	oldDistance = tourLength(order, costs);
+	if (order.size() <= min(options.exactStops, HELD_KARP_MAX_STOPS)) {
+		newDistance = solveExactTour(order, costs, &budget);
+		return;
+	}
+	unique_ptr<TourLocalSearch> localSearch;
+	if (options.method != OPTIMIZE_ANNEAL) {
+		localSearch.reset(new TourLocalSearch(costs, options.numNeighbors)); // candidate lists are shared by all chains
+	}
+	if (options.method == OPTIMIZE_LOCAL_SEARCH) {
+		newDistance = localSearch->improve(order, &budget);
+		return;
+	}
+
+	unsigned int numThreads = options.numThreads;
+	if (numThreads == 0) {
+		numThreads = max(1u, thread::hardware_concurrency());
+	}
+	unsigned int numChains = max(1u, options.numChains);
+	unsigned long long limit = budget.limit();
+	if (limit != 0 && limit < numChains) {
+		numChains = (unsigned int)limit; // every chain needs at least one evaluation of its own
+	}
+	numThreads = min(numThreads, numChains);
+
+	vector<vector<unsigned int> > results(numChains, order);
+	vector<double> lengths(numChains);
+	atomic<unsigned int> nextChain(0);
+	auto work = [&]() {
+		for (unsigned int c = nextChain++; c < numChains; c = nextChain++) {
+			FastRandom random(options.seed + c);
+			SearchBudget share(budget, limit == 0 ? 0 : limit / numChains + (c < limit % numChains ? 1 : 0));
+			lengths[c] = anneal(results[c], costs, options, random, share);
+			if (localSearch) {
+				lengths[c] = localSearch->improve(results[c], &share);
+			}
+		}
+	};
+	if (numThreads == 1) {
+		work();
+	}
+	else {
+		vector<thread> workers;
+		for (unsigned int i = 0; i < numThreads; i++) {
+			workers.push_back(thread(work));
+		}
+		for (thread& t : workers) {
+			t.join();
+		}
+	}
+
+	unsigned int best = 0;
+	for (unsigned int c = 1; c < numChains; c++) {
+		if (lengths[c] < lengths[best]) {
+			best = c;
+		}
+	}
+	order.swap(results[best]);
+	newDistance = lengths[best];
+}
+
+  // put deliveries in the visiting order given by matrix points (point i + 1 is deliveries[i])
+static void applyOrder(vector<DeliveryRequest>& deliveries, const vector<unsigned int>& order) {
+	vector<DeliveryRequest> reordered;
+	for (unsigned int p : order) {
+		reordered.push_back(deliveries[p - 1]);
+	}
+	deliveries = reordered;
+}
+
+void DeliveryOptimizerImpl::optimizeDeliveryOrder(
+    const GeoCoord& depot,
+    vector<DeliveryRequest>& deliveries,
+    double& oldCrowDistance,
+    double& newCrowDistance) const {
+	SearchBudget budget(options.timeLimit, options.maxEvaluations);
+	vector<GeoCoord> points(1, depot);
+	for (const DeliveryRequest& d : deliveries) {
+		points.push_back(d.location);
+	}
+	if (deliveries.size() > options.largeStops) { // too many stops for a full matrix
+		PointCosts crowDistance = [&](unsigned int a, unsigned int b) {
+			return distanceEarthMiles(points[a].latitude, points[a].longitude, points[b].latitude, points[b].longitude);
+		};
+		optimizeLarge(depot, deliveries, crowDistance, budget, oldCrowDistance, newCrowDistance);
+	}
+	else {
+		DistanceMatrix crowDistances;
+		crowDistances.computeStraightLine(points);
+		optimizeWithMatrix(deliveries, depot, crowDistances, budget, oldCrowDistance, newCrowDistance);
+	}
+	recordStats(budget);
+}
+
+void DeliveryOptimizerImpl::optimizeDeliveryOrder(
+    const GeoCoord& depot,
+    vector<DeliveryRequest>& deliveries,
+    const DistanceMatrix& costs,
+    double& oldDistance,
+    double& newDistance) const {
+	SearchBudget budget(options.timeLimit, options.maxEvaluations);
+	optimizeWithMatrix(deliveries, depot, costs, budget, oldDistance, newDistance);
+	recordStats(budget);
+}
+
+void DeliveryOptimizerImpl::optimizeWithMatrix(
+    vector<DeliveryRequest>& deliveries,
+    const GeoCoord& depot,
+    const DistanceMatrix& costs,
+    SearchBudget& budget,
+    double& oldDistance,
+    double& newDistance) const {
+	if (deliveries.size() > options.largeStops) {
+		PointCosts matrixCost = [&](unsigned int a, unsigned int b) { return costs(a, b); };
+		optimizeLarge(depot, deliveries, matrixCost, budget, oldDistance, newDistance);
+		return;
+	}
+	vector<unsigned int> order;
+	for (unsigned int i = 0; i < deliveries.size(); i++) {
+		order.push_back(i + 1);
+	}
+	optimizeOrder(order, costs, options, budget, oldDistance, newDistance);
+	applyOrder(deliveries, order);
+}
+
+void DeliveryOptimizerImpl::optimizeLarge(
+    const GeoCoord& depot,
+    vector<DeliveryRequest>& deliveries,
+    const PointCosts& costs,
+    SearchBudget& budget,
+    double& oldDistance,
+    double& newDistance) const {
+	vector<unsigned int> order;
+	vector<double> latitudes(1, depot.latitude), longitudes(1, depot.longitude);
+	oldDistance = 0;
+	for (unsigned int i = 0; i < deliveries.size(); i++) {
+		order.push_back(i + 1);
+		latitudes.push_back(deliveries[i].location.latitude);
+		longitudes.push_back(deliveries[i].location.longitude);
+		oldDistance += costs(i, i + 1);
+	}
+	oldDistance += costs((unsigned int)deliveries.size(), 0);
+
+	// clusters are already spread over the threads and are many searches between
+	// them, so each one gets a single thread and a single chain of the usual search.
+	// Every stop is solved about twice, once in its cluster and once in a window,
+	// so a cluster's share of the evaluations is its size over twice the stops.
+	OptimizerOptions clusterOptions = options;
+	clusterOptions.numThreads = 1;
+	clusterOptions.numChains = 1;
+	unsigned long long numPoints = deliveries.size() + 1;
+	SubTourSolver solveCluster = [&](vector<unsigned int>& clusterOrder, const DistanceMatrix& clusterCosts) {
+		SearchBudget share(budget, budget.limit() == 0 ? 0 : max(1ull, budget.limit() * clusterOrder.size() / (2 * numPoints)));
+		double before, after;
+		optimizeOrder(clusterOrder, clusterCosts, clusterOptions, share, before, after);
+	};
+	unsigned int numThreads = (options.numThreads == 0) ? max(1u, thread::hardware_concurrency()) : options.numThreads;
+	newDistance = optimizeLargeTour(order, latitudes, longitudes, costs, options.clusterSize, numThreads, solveCluster);
+	applyOrder(deliveries, order);
+}
+
+void DeliveryOptimizerImpl::recordStats(const SearchBudget& budget) const {
+	stats.seconds = budget.elapsedSeconds();
+	stats.evaluations = budget.used();
+	stats.stoppedEarly = budget.exhausted();
 }
 
 //******************** DeliveryOptimizer functions ****************************
@@ -116,3 +365,23 @@ void DeliveryOptimizer::optimizeDeliveryOrder(
 {
     return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
 }
+
+void DeliveryOptimizer::optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        const DistanceMatrix& costs,
+        double& oldDistance,
+        double& newDistance) const
+{
+    return m_impl->optimizeDeliveryOrder(depot, deliveries, costs, oldDistance, newDistance);
+}
+
+void DeliveryOptimizer::setOptions(const OptimizerOptions& options)
+{
+    m_impl->setOptions(options);
+}
+
+OptimizerStats DeliveryOptimizer::lastStats() const
+{
+    return m_impl->lastStats();
+}
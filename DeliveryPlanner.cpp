@@ -1,6 +1,12 @@
 #include "provided.h"
 #include "ExpandableHashMap.h"
+#include "DistanceMatrix.h"
+#include "StreetGraph.h"
+#include "SpatialIndex.h"
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 using namespace std;
 
 class DeliveryPlannerImpl
@@ -13,17 +19,59 @@ public:
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+    DeliveryResult snapToMap(GeoCoord& depot, vector<DeliveryRequest>& deliveries, unsigned int numThreads) const;
+    void setOptimizerOptions(const OptimizerOptions& options) { optimizerOptions = options; }
+    void setMaxSnapMiles(double miles) { maxSnapMiles = miles; }
 private:
 	const StreetMap* streetMap;
+	OptimizerOptions optimizerOptions;
+	double maxSnapMiles; // how far an address may be from the nearest intersection and still be delivered to
 };
 
 DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm)
 {
 	streetMap = sm;
+	maxSnapMiles = DEFAULT_MAX_SNAP_MILES;
 }
 
 DeliveryPlannerImpl::~DeliveryPlannerImpl() {
 
+}
+
+  // Addresses rarely fall exactly on an intersection, so move the depot and each
+  // stop that isn't one of the map's nodes to the nearest node, all in one batch
+  // query of the map's spatial index. BAD_COORD if one is more than maxSnapMiles from
+  // every intersection.
+DeliveryResult DeliveryPlannerImpl::snapToMap(GeoCoord& depot, vector<DeliveryRequest>& deliveries, unsigned int numThreads) const {
+	const StreetGraph& graph = streetMap->graph();
+	vector<GeoCoord> offMap;
+	vector<GeoCoord*> toMove;
+	if (graph.findNode(depot) == StreetGraph::NO_NODE) {
+		offMap.push_back(depot);
+		toMove.push_back(&depot);
+	}
+	for (DeliveryRequest& d : deliveries) {
+		if (graph.findNode(d.location) == StreetGraph::NO_NODE) {
+			offMap.push_back(d.location);
+			toMove.push_back(&d.location);
+		}
+	}
+	if (offMap.empty()) {
+		return DELIVERY_SUCCESS;
+	}
+	if (maxSnapMiles <= 0) {
+		return BAD_COORD; // only exact intersections are accepted
+	}
+	vector<unsigned int> nodes;
+	vector<double> miles;
+	streetMap->spatialIndex().nearestNodes(offMap, nodes, &miles, numThreads);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i] == StreetGraph::NO_NODE || miles[i] > maxSnapMiles) {
+			return BAD_COORD;
+		}
+		*toMove[i] = graph.coord(nodes[i]);
+	}
+	return DELIVERY_SUCCESS;
 }
 
 void getDirectionToTravel(double direction, string& dirToTravel) {
@@ -63,37 +111,87 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     double& totalDistanceTravelled) const
 {
 	totalDistanceTravelled = 0;
+	// every parallel step of the plan stays within the same thread count, so
+	// callers planning many manifests at once can give each plan one thread
+	unsigned int numThreads = optimizerOptions.numThreads;
+	if (numThreads == 0) {
+		numThreads = max(1u, thread::hardware_concurrency());
+	}
 	DeliveryOptimizer delOp(streetMap);
+	delOp.setOptions(optimizerOptions);
 	PointToPointRouter ptp(streetMap);
 	vector<DeliveryRequest> optimizedDeliveries = deliveries;
-	list<StreetSegment> route;
+	GeoCoord depotOnMap = depot;
+	DeliveryResult snapResult = snapToMap(depotOnMap, optimizedDeliveries, numThreads);
+	if (snapResult != DELIVERY_SUCCESS) {
+		return snapResult;
+	}
 	double oldDist, newDist;
-	delOp.optimizeDeliveryOrder(depot, optimizedDeliveries, oldDist, newDist);
+
+	// order the stops by road distance: one batch of searches between every pair
+	// of stops, run in parallel, instead of straight-line guesses. A matrix for a
+	// huge manifest would be too big, so those are clustered on straight lines.
+	if (deliveries.size() > optimizerOptions.largeStops) {
+		delOp.optimizeDeliveryOrder(depotOnMap, optimizedDeliveries, oldDist, newDist);
+	}
+	else {
+		vector<GeoCoord> points(1, depotOnMap);
+		for (const DeliveryRequest& d : optimizedDeliveries) {
+			points.push_back(d.location);
+		}
+		DistanceMatrix roadDistances;
+		DeliveryResult matrixResult = roadDistances.computeRoad(*streetMap, points, numThreads);
+		if (matrixResult != DELIVERY_SUCCESS) {
+			return matrixResult;
+		}
+		delOp.optimizeDeliveryOrder(depotOnMap, optimizedDeliveries, roadDistances, oldDist, newDist);
+	}
 
 	unsigned int numDeliveries = optimizedDeliveries.size();
+	if (numDeliveries == 0) {
+		return DELIVERY_SUCCESS; // nowhere to go
+	}
 
-	for (unsigned int i = 0; i <= numDeliveries; i++) {
-		unsigned int index = i;
-		DeliveryResult dr;
-		if (i == 0) { // start from depot for first item
-			dr = ptp.generatePointToPointRoute(depot, optimizedDeliveries[index].location, route, totalDistanceTravelled);
-			if (dr != DELIVERY_SUCCESS) {
-				return dr;
-			}
+	// With the order fixed the legs (depot -> first stop, stop to stop, last stop
+	// -> depot) don't depend on each other, so route them all at once, one leg at
+	// a time per thread. The router lends each thread its own workspace.
+	unsigned int numLegs = numDeliveries + 1;
+	vector<list<StreetSegment> > routes(numLegs);
+	vector<double> legDistances(numLegs, 0);
+	vector<DeliveryResult> legResults(numLegs, DELIVERY_SUCCESS);
+	atomic<unsigned int> nextLeg(0);
+	auto work = [&]() {
+		for (unsigned int i = nextLeg++; i < numLegs; i = nextLeg++) {
+			const GeoCoord& from = (i == 0) ? depotOnMap : optimizedDeliveries[i - 1].location;
+			const GeoCoord& to = (i < numDeliveries) ? optimizedDeliveries[i].location : depotOnMap;
+			legResults[i] = ptp.generatePointToPointRoute(from, to, routes[i], legDistances[i]);
 		}
-		else if (i < numDeliveries) { // start from prev delivery location for next items
-			dr = ptp.generatePointToPointRoute(optimizedDeliveries[index - 1].location, optimizedDeliveries[index].location, route, totalDistanceTravelled);
-			if (dr != DELIVERY_SUCCESS) {
-				return dr;
-			}
+	};
+	numThreads = min(numThreads, numLegs);
+	if (numThreads == 1) {
+		work();
+	}
+	else {
+		vector<thread> workers;
+		for (unsigned int i = 0; i < numThreads; i++) {
+			workers.push_back(thread(work));
 		}
-		else { // go back to depot after last delivery has been made
-			--index;
-			dr = ptp.generatePointToPointRoute(optimizedDeliveries[index].location, depot, route, totalDistanceTravelled);
+		for (thread& t : workers) {
+			t.join();
 		}
+	}
+
+	// then build the commands leg by leg, in order, exactly as if routed one by one
+	for (unsigned int i = 0; i < numLegs; i++) {
+		if (legResults[i] != DELIVERY_SUCCESS) { // the first leg in order that failed, the return leg included
+			return legResults[i];
+		}
+		totalDistanceTravelled += legDistances[i];
+		const list<StreetSegment>& route = routes[i];
+		unsigned int index = (i < numDeliveries) ? i : i - 1;
 
-		StreetSegment* prevSeg = nullptr;
-		StreetSegment* currSeg = nullptr;
+		const StreetSegment* prevSeg = nullptr;
+		const StreetSegment* currSeg = nullptr;
 		string itemToDeliver = optimizedDeliveries[index].item;
 		string prevStreet = ""; // name of previous street segment
 
@@ -152,12 +250,11 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
 				commands.push_back(proceed);
 				prevStreet = currSeg->name;
 			}
-
-			if ((*currSeg).end == optimizedDeliveries[index].location) { // deliver command
-				commands.push_back(deliver);
-			}
 			it++;
 		}
+		if (i < numDeliveries) { // every leg but the last ends at a delivery (even an empty leg to the same spot)
+			commands.push_back(deliver);
+		}
 	}
 	return DELIVERY_SUCCESS;
 }
@@ -185,3 +282,13 @@ DeliveryResult DeliveryPlanner::generateDeliveryPlan(
 {
     return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled);
 }
+
+void DeliveryPlanner::setOptimizerOptions(const OptimizerOptions& options)
+{
+    m_impl->setOptimizerOptions(options);
+}
+
+void DeliveryPlanner::setMaxSnapMiles(double miles)
+{
+    m_impl->setMaxSnapMiles(miles);
+}
@@ -0,0 +1,141 @@
+#include "DistanceMatrix.h"
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include "RouteCache.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+// One-to-many Dijkstra from nodes[source], writing row source of distances.
+// Several points may share a node, so the search counts down the numTargets
+// distinct nodes marked in isTarget and fills the columns in once it is over.
+static void searchRow(const StreetGraph& g, const vector<unsigned int>& nodes, const vector<char>& isTarget,
+                      unsigned int numTargets, unsigned int source, SearchWorkspace& ws, double* row)
+{
+	unsigned int size = (unsigned int)nodes.size();
+	ws.reset(g.numNodes());
+	IndexedHeap<4>& open = ws.openList();
+	ws.label(nodes[source], 0, nullptr);
+	open.push(nodes[source], 0);
+	unsigned int remaining = numTargets;
+	while (!open.empty() && remaining > 0) {
+		unsigned int q = open.pop();
+		ws.close(q);
+		if (isTarget[q]) {
+			remaining--;
+		}
+		double gq = ws.g(q);
+		for (const StreetEdge& e : g.edgesFrom(q)) {
+			double gNew = gq + e.length;
+			if (!ws.closed(e.to) && gNew < ws.g(e.to)) {
+				ws.label(e.to, gNew, &e);
+				open.pushOrDecrease(e.to, gNew);
+			}
+		}
+	}
+	for (unsigned int j = 0; j < size; j++) {
+		if (ws.closed(nodes[j])) {
+			row[j] = ws.g(nodes[j]);
+		}
+	}
+}
+
+  // Put the route to every point the last searchRow reached into the cache, read
+  // off the search's parent edges, so the legs of a plan made from this matrix
+  // (and later matrices over the same stops) needn't be searched for again.
+static void cacheRow(RouteCache& cache, const StreetGraph& g, const vector<unsigned int>& nodes, unsigned int source,
+                     const SearchWorkspace& ws)
+{
+	vector<unsigned int> path;
+	for (unsigned int j = 0; j < nodes.size(); j++) {
+		unsigned int target = nodes[j];
+		if (target == nodes[source] || !ws.closed(target)) {
+			continue;
+		}
+		path.clear();
+		for (unsigned int v = target; v != nodes[source]; v = ws.parent(v)->from) {
+			path.push_back(g.edgeIndex(*ws.parent(v)));
+		}
+		reverse(path.begin(), path.end());
+		cache.insert(nodes[source], target, path, ws.g(target));
+	}
+}
+
+DistanceMatrix::DistanceMatrix()
+ : m_size(0)
+{}
+
+DeliveryResult DistanceMatrix::computeRoad(const StreetMap& map, const vector<GeoCoord>& points, unsigned int numThreads) {
+	const StreetGraph& g = map.graph();
+	m_size = (unsigned int)points.size();
+	m_distances.assign((size_t)m_size * m_size, numeric_limits<double>::infinity());
+	vector<unsigned int> nodes(m_size);
+	vector<char> isTarget(g.numNodes(), false);
+	unsigned int numTargets = 0;
+	for (unsigned int i = 0; i < m_size; i++) {
+		nodes[i] = g.findNode(points[i]);
+		if (nodes[i] == StreetGraph::NO_NODE) {
+			return BAD_COORD;
+		}
+		if (!isTarget[nodes[i]]) {
+			isTarget[nodes[i]] = true;
+			numTargets++;
+		}
+	}
+
+	// rows are handed out one at a time, so a slow search doesn't hold up a whole batch
+	if (numThreads == 0) {
+		numThreads = max(1u, thread::hardware_concurrency());
+	}
+	numThreads = max(1u, min(numThreads, m_size));
+	// with a route cache, rows whose routes are all cached skip their search, and
+	// the others feed theirs back, unless the matrix would fill over half the cache
+	RouteCache* cache = map.routeCache();
+	bool fillCache = cache != nullptr && (unsigned long long)m_size * m_size <= cache->capacity() / 2;
+	atomic<unsigned int> nextRow(0);
+	auto work = [&]() {
+		SearchWorkspace ws;
+		for (unsigned int row = nextRow++; row < m_size; row = nextRow++) {
+			double* distances = &m_distances[(size_t)row * m_size];
+			if (cache != nullptr && cache->findLengths(nodes[row], nodes, distances)) {
+				continue;
+			}
+			searchRow(g, nodes, isTarget, numTargets, row, ws, distances);
+			if (fillCache) {
+				cacheRow(*cache, g, nodes, row, ws);
+			}
+		}
+	};
+	if (numThreads == 1) {
+		work();
+	}
+	else {
+		vector<thread> workers;
+		for (unsigned int i = 0; i < numThreads; i++) {
+			workers.push_back(thread(work));
+		}
+		for (thread& t : workers) {
+			t.join();
+		}
+	}
+
+	for (double d : m_distances) {
+		if (d == numeric_limits<double>::infinity()) {
+			return NO_ROUTE;
+		}
+	}
+	return DELIVERY_SUCCESS;
+}
+
+void DistanceMatrix::computeStraightLine(const vector<GeoCoord>& points) {
+	m_size = (unsigned int)points.size();
+	m_distances.resize((size_t)m_size * m_size);
+	for (unsigned int i = 0; i < m_size; i++) {
+		for (unsigned int j = 0; j < m_size; j++) {
+			m_distances[(size_t)i * m_size + j] = distanceEarthMiles(points[i], points[j]);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef DISTANCEMATRIX_INCLUDED
+#define DISTANCEMATRIX_INCLUDED
+
+#include "provided.h"
+#include <vector>
+
+// Distances in miles between every pair of a list of points, stored row-major.
+// Road distances come from one Dijkstra search per point over the StreetMap
+// graph, which stops as soon as every other point is settled; the searches run
+// in parallel, one workspace per thread. Streets are two-way, so the matrix is
+// symmetric, but each row is searched on its own so no thread waits on another.
+class DistanceMatrix
+{
+public:
+	DistanceMatrix();
+
+	  // road distances between the points (infinite where no route exists). Returns
+	  // BAD_COORD if a point isn't on the map, NO_ROUTE if some pair can't reach each
+	  // other, DELIVERY_SUCCESS otherwise. numThreads 0 means one per core.
+	DeliveryResult computeRoad(const StreetMap& map, const std::vector<GeoCoord>& points, unsigned int numThreads);
+	  // straight-line distances between the points
+	void computeStraightLine(const std::vector<GeoCoord>& points);
+	  // size x size costs from cost(from, to), for matrices over made-up points
+	template<class CostFunction>
+	void computeWith(unsigned int size, CostFunction cost)
+	{
+		m_size = size;
+		m_distances.resize((size_t)size * size);
+		for (unsigned int i = 0; i < size; i++) {
+			for (unsigned int j = 0; j < size; j++) {
+				m_distances[(size_t)i * size + j] = cost(i, j);
+			}
+		}
+	}
+
+	unsigned int size() const { return m_size; }
+	double operator()(unsigned int from, unsigned int to) const { return m_distances[(size_t)from * m_size + to]; }
+
+private:
+	unsigned int m_size;
+	std::vector<double> m_distances;
+};
+
+#endif // DISTANCEMATRIX_INCLUDED
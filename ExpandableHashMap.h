@@ -7,8 +7,12 @@
 #include <functional>
 #include <algorithm>
 #include <iostream>
+#include "HashPolicy.h"
 
-template<typename KeyType, typename ValueType>
+  // Hash and KeyEqual are policy types (see HashPolicy.h); the bucket count is
+  // always a power of two, so a hash is reduced with a mask instead of %
+template<typename KeyType, typename ValueType,
+         typename Hash = DefaultHash<KeyType>, typename KeyEqual = DefaultEqual<KeyType> >
 class ExpandableHashMap
 {
 public:
@@ -36,14 +40,17 @@ private:
 		KeyType key;
 		ValueType val;
 	};
+	static unsigned int hashOf(const KeyType& key) { return Hash()(key); }
+	static bool equal(const KeyType& lhs, const KeyType& rhs) { return KeyEqual()(lhs, rhs); }
+
 	int numVals;
 	int numBuckets;
 	double maxLoad;
 	std::list<Node>* hashMap;
 };
 
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFactor) {
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+ExpandableHashMap<KeyType, ValueType, Hash, KeyEqual>::ExpandableHashMap(double maximumLoadFactor) {
 	if (maximumLoadFactor > 0) {
 		maxLoad = maximumLoadFactor;
 	}
@@ -55,16 +62,16 @@ ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFacto
 	hashMap = new std::list<Node>[8];
 }
 
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::~ExpandableHashMap() {
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+ExpandableHashMap<KeyType, ValueType, Hash, KeyEqual>::~ExpandableHashMap() {
 	for (int i = 0; i < numBuckets; i++) { // loop through hash map and delete
 		hashMap[i].erase(hashMap[i].begin(), hashMap[i].end());
 	}
 	delete[] hashMap;
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::reset() {
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void ExpandableHashMap<KeyType, ValueType, Hash, KeyEqual>::reset() {
 	for (int i = 0; i < numBuckets; i++) { // delete the current hash map
 		hashMap[i].erase(hashMap[i].begin(), hashMap[i].end());
 	}
@@ -74,19 +81,18 @@ void ExpandableHashMap<KeyType, ValueType>::reset() {
 	hashMap = new std::list<Node>[8]; // create a new one with 8 buckets and no associations
 }
 
-template<typename KeyType, typename ValueType>
-int ExpandableHashMap<KeyType, ValueType>::size() const {
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+int ExpandableHashMap<KeyType, ValueType, Hash, KeyEqual>::size() const {
     return numVals;
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value) {
-	unsigned int hasher(const KeyType & key);
-	unsigned int bucket = hasher(key) % numBuckets; // determine the correct bucket
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void ExpandableHashMap<KeyType, ValueType, Hash, KeyEqual>::associate(const KeyType& key, const ValueType& value) {
+	unsigned int bucket = hashOf(key) & (numBuckets - 1); // determine the correct bucket
 	auto it = hashMap[bucket].begin();
 	bool added = false;
 	while (it != hashMap[bucket].end() && added == false) { // if it hasn't been added yet, keep going
-		if ((*it).key == key) { // if the key is equal to one already in the bucket, update the value
+		if (equal((*it).key, key)) { // if the key is equal to one already in the bucket, update the value
 			(*it).val = value;
 			added = true;
 		}
@@ -108,7 +114,7 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
 			auto it = oldHashMap[i].begin();
 			while (it != oldHashMap[i].end()) { // loop through old one and rehash values into new map
 				Node p = *it;
-				unsigned int b = hasher(p.key) % (numBuckets * 2);
+				unsigned int b = hashOf(p.key) & (numBuckets * 2 - 1);
 				hashMap[b].push_back(p);
 				it++;
 			}
@@ -119,13 +125,12 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
 	}
 }
 
-template<typename KeyType, typename ValueType>
-const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key) const {
-	unsigned int hasher(const KeyType& key);
-	unsigned int bucket = hasher(key) % numBuckets; // determine the bucket where the key should be
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Hash, KeyEqual>::find(const KeyType& key) const {
+	unsigned int bucket = hashOf(key) & (numBuckets - 1); // determine the bucket where the key should be
 	auto it = hashMap[bucket].begin();
 	while (it != hashMap[bucket].end()) { // loop through that bucket
-		if ((*it).key == key) { // if the key is found in the node, return the value
+		if (equal((*it).key, key)) { // if the key is found in the node, return the value
 			ValueType* v = &((*it).val);
 			return v;
 		}
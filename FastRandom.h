@@ -0,0 +1,54 @@
+#ifndef FASTRANDOM_INCLUDED
+#define FASTRANDOM_INCLUDED
+
+// A small, fast pseudo-random generator (xoshiro256**) for code that needs its
+// own reproducible stream, such as one annealing chain per thread. Unlike rand()
+// it has no shared state, so threads never contend or disturb each other's
+// sequences. The 64-bit seed is spread over the 256-bit state with splitmix64,
+// so nearby seeds (seed, seed + 1, ...) still give unrelated streams.
+class FastRandom
+{
+public:
+	explicit FastRandom(unsigned long long seed)
+	{
+		for (int i = 0; i < 4; i++) {
+			seed += 0x9E3779B97F4A7C15ull; // splitmix64
+			unsigned long long z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			m_state[i] = z ^ (z >> 31);
+		}
+	}
+
+	unsigned long long next()
+	{
+		unsigned long long result = rotl(m_state[1] * 5, 7) * 9;
+		unsigned long long t = m_state[1] << 17;
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= t;
+		m_state[3] = rotl(m_state[3], 45);
+		return result;
+	}
+
+	  // uniform in 0..n-1 (n > 0), by multiplying instead of a slow, biased %
+	unsigned int below(unsigned int n)
+	{
+		return (unsigned int)(((next() >> 32) * n) >> 32);
+	}
+
+	  // uniform in [0, 1)
+	double uniform()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+private:
+	static unsigned long long rotl(unsigned long long x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	unsigned long long m_state[4];
+};
+
+#endif // FASTRANDOM_INCLUDED
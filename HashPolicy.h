@@ -0,0 +1,51 @@
+#ifndef HASHPOLICY_INCLUDED
+#define HASHPOLICY_INCLUDED
+
+#include <type_traits>
+#include <functional>
+
+// Hash and equality policies for ExpandableHashMap and OpenHashMap. The maps
+// take them as template parameters, so a call inlines into the probe loop and
+// each instantiation can pick its own. Both maps size their tables in powers of
+// two and reduce a hash with a mask, so a policy has to mix well into the low bits.
+
+  // Fibonacci hashing: multiply by 2^64 / golden ratio and keep the high half,
+  // which depends on every bit of the key
+inline unsigned int fibonacciHash(unsigned long long k)
+{
+	return (unsigned int)((k * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// The default policy is chosen at compile time from the key type. Integral keys
+// (node ids, and CoordKeys, which pack a coordinate into one 64-bit integer)
+// take the Fibonacci fast path; every other key calls the free function
+// unsigned int hasher(const KeyType&) that the key's own code provides.
+template<typename KeyType, bool Integral = std::is_integral<KeyType>::value>
+struct DefaultHash
+{
+	unsigned int operator()(const KeyType& key) const
+	{
+		unsigned int hasher(const KeyType& key);
+		return hasher(key);
+	}
+};
+
+template<typename KeyType>
+struct DefaultHash<KeyType, true>
+{
+	unsigned int operator()(KeyType key) const
+	{
+		return fibonacciHash((unsigned long long)key);
+	}
+};
+
+template<typename KeyType>
+struct DefaultEqual
+{
+	bool operator()(const KeyType& lhs, const KeyType& rhs) const
+	{
+		return lhs == rhs;
+	}
+};
+
+#endif // HASHPOLICY_INCLUDED
@@ -0,0 +1,97 @@
+#include "HeldKarp.h"
+#include <vector>
+#include <limits>
+using namespace std;
+
+double solveExactTour(vector<unsigned int>& order, const DistanceMatrix& costs, SearchBudget* budget) {
+	unsigned int n = (unsigned int)order.size();
+	if (n == 0) {
+		return costs.size() == 0 ? 0 : costs(0, 0);
+	}
+	if (n > HELD_KARP_MAX_STOPS) {
+		return numeric_limits<double>::infinity(); // caller's job not to ask
+	}
+
+	// best[mask * n + j]: shortest path from the depot through exactly the stops in
+	// mask, ending at stop j (which is in mask); from[] remembers the stop before j.
+	// Each set's row is filled in one go by pulling from the smaller sets' rows,
+	// so the writes stream through the table in order and every read is a whole
+	// row of n distances scanned front to back, next to the costs into stop k
+	// (costTo, the matrix transposed into visiting order). Slots for stops not in
+	// a set stay infinite, which lets the inner loop run without a membership test.
+	const double INF = numeric_limits<double>::infinity();
+	size_t numSets = (size_t)1 << n;
+	vector<double> best(numSets * n, INF);
+	vector<unsigned char> from(numSets * n, 0);
+	vector<double> costTo((size_t)n * n);
+	for (unsigned int k = 0; k < n; k++) {
+		for (unsigned int j = 0; j < n; j++) {
+			costTo[(size_t)k * n + j] = costs(order[j], order[k]);
+		}
+		best[((size_t)1 << k) * n + k] = costs(0, order[k]);
+	}
+	unsigned long long uncharged = 0; // extensions tried since the budget was last charged
+	for (size_t mask = 3; mask < numSets; mask++) {
+		if ((mask & (mask - 1)) == 0) {
+			continue; // a single stop, already set
+		}
+		if (budget != nullptr && uncharged >= BUDGET_BATCH) {
+			bool spent = budget->charge(uncharged);
+			uncharged = 0;
+			if (spent) {
+				double length = costs(0, order[0]);
+				for (unsigned int i = 1; i < n; i++) {
+					length += costs(order[i - 1], order[i]);
+				}
+				return length + costs(order[n - 1], 0);
+			}
+		}
+		double* row = &best[mask * n];
+		unsigned char* rowFrom = &from[mask * n];
+		for (unsigned int k = 0; k < n; k++) { // the path through mask that ends at k...
+			if (!(mask & ((size_t)1 << k))) {
+				continue;
+			}
+			const double* prev = &best[(mask & ~((size_t)1 << k)) * n]; // ...extends one through the rest
+			const double* into = &costTo[(size_t)k * n];
+			double shortest = INF;
+			unsigned int before = 0;
+			for (unsigned int j = 0; j < n; j++) {
+				double length = prev[j] + into[j];
+				if (length < shortest) {
+					shortest = length;
+					before = j;
+				}
+			}
+			uncharged += n;
+			row[k] = shortest;
+			rowFrom[k] = (unsigned char)before;
+		}
+	}
+
+	if (budget != nullptr) {
+		budget->charge(uncharged);
+	}
+
+	// close the cycle back to the depot, then walk the choices backwards
+	size_t all = numSets - 1;
+	unsigned int last = 0;
+	double shortest = INF;
+	for (unsigned int j = 0; j < n; j++) {
+		double length = best[all * n + j] + costs(order[j], 0);
+		if (length < shortest) {
+			shortest = length;
+			last = j;
+		}
+	}
+	vector<unsigned int> tour(n);
+	size_t mask = all;
+	for (unsigned int i = n; i-- > 0; ) {
+		tour[i] = order[last];
+		unsigned int prev = from[mask * n + last];
+		mask &= ~((size_t)1 << last);
+		last = prev;
+	}
+	order.swap(tour);
+	return shortest;
+}
@@ -0,0 +1,21 @@
+#ifndef HELDKARP_INCLUDED
+#define HELDKARP_INCLUDED
+
+#include "DistanceMatrix.h"
+#include "SearchBudget.h"
+#include <vector>
+
+// The largest number of stops solveExactTour accepts: its tables grow as
+// 2^n * n, which is about 160 MB of distances at 20 stops.
+const unsigned int HELD_KARP_MAX_STOPS = 20;
+
+// Reorder the stops (matrix points, with the depot at point 0) into a shortest
+// depot -> stops -> depot tour and return its length. Held-Karp dynamic
+// programming over subsets: the best way to visit a set of stops ending at a
+// given one extends the best ways of visiting that set minus its last stop. Ties
+// go to the lower index, so the answer is deterministic. Costs may be asymmetric.
+// If the budget runs out before the tables are done there is no tour to show for
+// it, so order is left as it was and its length returned.
+double solveExactTour(std::vector<unsigned int>& order, const DistanceMatrix& costs, SearchBudget* budget = nullptr);
+
+#endif // HELDKARP_INCLUDED
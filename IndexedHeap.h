@@ -0,0 +1,163 @@
+#ifndef INDEXEDHEAP_INCLUDED
+#define INDEXEDHEAP_INCLUDED
+
+#include <vector>
+
+// A d-ary min-heap of node ids keyed by double priorities, with an index from
+// node id to heap position so a queued node's priority can be lowered in place
+// (decrease-key) instead of being queued a second time. Node ids must be below
+// the capacity passed to resize(). A wider heap (D = 4) is shallower than a
+// binary one, so sift-downs touch fewer cache lines.
+template<unsigned int D = 4>
+class IndexedHeap
+{
+public:
+	static const unsigned int NOT_QUEUED = 0xFFFFFFFFu;
+
+	IndexedHeap() {}
+
+	  // allow node ids 0..numNodes-1; leaves the heap empty
+	void resize(unsigned int numNodes)
+	{
+		m_pos.assign(numNodes, NOT_QUEUED);
+		m_heap.clear();
+	}
+
+	  // empty the heap; only touches the nodes that are still queued
+	void clear()
+	{
+		for (const Entry& e : m_heap) {
+			m_pos[e.node] = NOT_QUEUED;
+		}
+		m_heap.clear();
+	}
+
+	bool empty() const { return m_heap.empty(); }
+	unsigned int size() const { return (unsigned int)m_heap.size(); }
+	bool contains(unsigned int node) const { return m_pos[node] != NOT_QUEUED; }
+	unsigned int top() const { return m_heap[0].node; }
+	double topKey() const { return m_heap[0].key; }
+	double key(unsigned int node) const { return m_heap[m_pos[node]].key; }
+
+	void push(unsigned int node, double key)
+	{
+		Entry e;
+		e.key = key;
+		e.node = node;
+		m_heap.push_back(e);
+		m_pos[node] = (unsigned int)m_heap.size() - 1;
+		siftUp((unsigned int)m_heap.size() - 1);
+	}
+
+	  // lower a queued node's key; a key that isn't lower is ignored
+	void decreaseKey(unsigned int node, double key)
+	{
+		unsigned int i = m_pos[node];
+		if (key < m_heap[i].key) {
+			m_heap[i].key = key;
+			siftUp(i);
+		}
+	}
+
+	  // set a queued node's key, moving it up or down as needed
+	void changeKey(unsigned int node, double key)
+	{
+		unsigned int i = m_pos[node];
+		double old = m_heap[i].key;
+		m_heap[i].key = key;
+		if (key < old) {
+			siftUp(i);
+		}
+		else {
+			siftDown(i);
+		}
+	}
+
+	  // push the node, or lower its key if it is already queued
+	void pushOrDecrease(unsigned int node, double key)
+	{
+		if (contains(node)) {
+			decreaseKey(node, key);
+		}
+		else {
+			push(node, key);
+		}
+	}
+
+	unsigned int pop()
+	{
+		unsigned int node = m_heap[0].node;
+		m_pos[node] = NOT_QUEUED;
+		Entry last = m_heap.back();
+		m_heap.pop_back();
+		if (!m_heap.empty()) {
+			m_heap[0] = last;
+			m_pos[last.node] = 0;
+			siftDown(0);
+		}
+		return node;
+	}
+
+private:
+	struct Entry {
+		double key;
+		unsigned int node;
+	};
+
+	  // ties go to the smaller node id, so the search order doesn't depend on heap history
+	static bool before(const Entry& a, const Entry& b)
+	{
+		return a.key < b.key || (a.key == b.key && a.node < b.node);
+	}
+
+	void siftUp(unsigned int i)
+	{
+		Entry e = m_heap[i];
+		while (i > 0) {
+			unsigned int parent = (i - 1) / D;
+			if (!before(e, m_heap[parent])) {
+				break;
+			}
+			m_heap[i] = m_heap[parent];
+			m_pos[m_heap[i].node] = i;
+			i = parent;
+		}
+		m_heap[i] = e;
+		m_pos[e.node] = i;
+	}
+
+	void siftDown(unsigned int i)
+	{
+		Entry e = m_heap[i];
+		unsigned int n = (unsigned int)m_heap.size();
+		for (;;) {
+			unsigned int first = i * D + 1;
+			if (first >= n) {
+				break;
+			}
+			unsigned int best = first;
+			unsigned int last = (first + D < n) ? first + D : n;
+			for (unsigned int c = first + 1; c < last; c++) {
+				if (before(m_heap[c], m_heap[best])) {
+					best = c;
+				}
+			}
+			if (!before(m_heap[best], e)) {
+				break;
+			}
+			m_heap[i] = m_heap[best];
+			m_pos[m_heap[i].node] = i;
+			i = best;
+		}
+		m_heap[i] = e;
+		m_pos[e.node] = i;
+	}
+
+	std::vector<Entry> m_heap;
+	std::vector<unsigned int> m_pos; // heap index of each node, or NOT_QUEUED
+};
+
+template<unsigned int D>
+const unsigned int IndexedHeap<D>::NOT_QUEUED;
+
+#endif // INDEXEDHEAP_INCLUDED
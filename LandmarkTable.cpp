@@ -0,0 +1,279 @@
+#include "LandmarkTable.h"
+#include "SearchWorkspace.h"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+// a float keeps 24 significant bits, so storing a distance moves it by at most
+// half of 2^-23 of its value; the bound gives up that much for each operand
+static const double FLOAT_SLACK = 1.0 / (1 << 23);
+
+// Plain Dijkstra from source over the whole graph. Fills dist (infinite where
+// unreachable) and, if order isn't null, the nodes in the order they settled;
+// the shortest path tree is left in ws's parent edges.
+static void shortestDistances(const StreetGraph& g, unsigned int source, SearchWorkspace& ws,
+                              vector<double>& dist, vector<unsigned int>* order)
+{
+	ws.reset(g.numNodes());
+	IndexedHeap<4>& open = ws.openList();
+	ws.label(source, 0, nullptr);
+	open.push(source, 0);
+	if (order != nullptr) {
+		order->clear();
+	}
+	while (!open.empty()) {
+		unsigned int q = open.pop();
+		ws.close(q);
+		if (order != nullptr) {
+			order->push_back(q);
+		}
+		double gq = ws.g(q);
+		for (const StreetEdge& e : g.edgesFrom(q)) {
+			double gNew = gq + e.length;
+			if (!ws.closed(e.to) && gNew < ws.g(e.to)) {
+				ws.label(e.to, gNew, &e);
+				open.pushOrDecrease(e.to, gNew);
+			}
+		}
+	}
+	dist.resize(g.numNodes());
+	for (unsigned int v = 0; v < g.numNodes(); v++) {
+		dist[v] = ws.g(v);
+	}
+}
+
+  // some node of the largest connected piece of the map; maps often carry small
+  // islands of streets that no route from the main network can reach
+static unsigned int nodeInLargestComponent(const StreetGraph& g)
+{
+	vector<unsigned int> component(g.numNodes(), StreetGraph::NO_NODE);
+	vector<unsigned int> stack;
+	unsigned int best = 0, bestSize = 0;
+	for (unsigned int s = 0; s < g.numNodes(); s++) {
+		if (component[s] != StreetGraph::NO_NODE) {
+			continue;
+		}
+		unsigned int size = 0;
+		component[s] = s;
+		stack.push_back(s);
+		while (!stack.empty()) {
+			unsigned int v = stack.back();
+			stack.pop_back();
+			size++;
+			for (const StreetEdge& e : g.edgesFrom(v)) {
+				if (component[e.to] == StreetGraph::NO_NODE) {
+					component[e.to] = s;
+					stack.push_back(e.to);
+				}
+			}
+		}
+		if (size > bestSize) {
+			best = s;
+			bestSize = size;
+		}
+	}
+	return best;
+}
+
+  // the reachable node farthest from every landmark so far, lowest id on ties
+static unsigned int farthestNode(const vector<double>& nearestLandmark)
+{
+	unsigned int best = StreetGraph::NO_NODE;
+	for (unsigned int v = 0; v < nearestLandmark.size(); v++) {
+		if (!isinf(nearestLandmark[v]) && (best == StreetGraph::NO_NODE || nearestLandmark[v] > nearestLandmark[best])) {
+			best = v;
+		}
+	}
+	return best;
+}
+
+//******************** LandmarkTable functions ********************************
+
+LandmarkTable::LandmarkTable() {
+	clear();
+}
+
+void LandmarkTable::clear() {
+	m_ownedLandmarks.clear();
+	m_ownedDistances.clear();
+	bind();
+}
+
+void LandmarkTable::bind() {
+	m_numNodes = m_ownedLandmarks.empty() ? 0 : (unsigned int)(m_ownedDistances.size() / m_ownedLandmarks.size());
+	m_numLandmarks = (unsigned int)m_ownedLandmarks.size();
+	m_landmarks = m_ownedLandmarks.data();
+	m_distances = m_ownedDistances.data();
+}
+
+void LandmarkTable::build(const StreetGraph& g, unsigned int count, LandmarkSelection selection) {
+	clear();
+	unsigned int numNodes = g.numNodes();
+	if (numNodes == 0 || count == 0) {
+		return;
+	}
+
+	SearchWorkspace ws;
+	vector<double> dist;
+	vector<unsigned int> order;
+	vector<vector<double> > fromLandmark; // kept in double while building so bounds stay exact
+	vector<double> nearestLandmark(numNodes, numeric_limits<double>::infinity());
+	vector<bool> isLandmark(numNodes, false);
+
+	// landmarks all go in the main road network (nodes elsewhere keep infinite
+	// distances and get the straight-line bound); the first is the node farthest
+	// from an arbitrary start there, which lands it on the edge of the map
+	shortestDistances(g, nodeInLargestComponent(g), ws, dist, nullptr);
+	unsigned int next = farthestNode(dist);
+	while (m_ownedLandmarks.size() < count) {
+		m_ownedLandmarks.push_back(next);
+		isLandmark[next] = true;
+		fromLandmark.push_back(vector<double>());
+		shortestDistances(g, next, ws, fromLandmark.back(), nullptr);
+		for (unsigned int v = 0; v < numNodes; v++) {
+			nearestLandmark[v] = min(nearestLandmark[v], fromLandmark.back()[v]);
+		}
+		if (m_ownedLandmarks.size() == count) {
+			break;
+		}
+
+		next = farthestNode(nearestLandmark);
+		if (nearestLandmark[next] == 0) {
+			break; // every node it could pick already is a landmark
+		}
+		if (selection != LANDMARKS_AVOID) {
+			continue;
+		}
+
+		// avoid: grow a shortest path tree from a node far from the landmarks; a
+		// node's weight is how much the current landmarks underestimate its
+		// distance from the root, and a subtree's size is its total weight (zero if
+		// it already holds a landmark). Walk down into the heaviest subtree.
+		unsigned int root = next;
+		shortestDistances(g, root, ws, dist, &order);
+		vector<double> size(numNodes, 0);
+		vector<bool> covered(numNodes, false);
+		for (unsigned int i = (unsigned int)order.size(); i-- > 0; ) { // children settle after parents
+			unsigned int v = order[i];
+			double bound = 0;
+			for (const vector<double>& d : fromLandmark) {
+				if (!isinf(d[v]) && !isinf(d[root])) {
+					bound = max(bound, fabs(d[v] - d[root]));
+				}
+			}
+			covered[v] = covered[v] || isLandmark[v];
+			size[v] = covered[v] ? 0 : size[v] + (dist[v] - bound);
+			const StreetEdge* p = ws.parent(v);
+			if (p != nullptr) {
+				size[p->from] += size[v];
+				covered[p->from] = covered[p->from] || covered[v];
+			}
+		}
+		if (size[root] <= 0) {
+			continue; // every subtree is covered; fall back to the farthest node
+		}
+		vector<vector<unsigned int> > children(numNodes);
+		for (unsigned int v : order) {
+			if (ws.parent(v) != nullptr) {
+				children[ws.parent(v)->from].push_back(v);
+			}
+		}
+		unsigned int v = root;
+		for (;;) {
+			unsigned int heaviest = StreetGraph::NO_NODE;
+			for (unsigned int c : children[v]) {
+				if (size[c] > 0 && (heaviest == StreetGraph::NO_NODE || size[c] > size[heaviest])) {
+					heaviest = c;
+				}
+			}
+			if (heaviest == StreetGraph::NO_NODE) {
+				break;
+			}
+			v = heaviest;
+		}
+		next = v;
+	}
+
+	count = (unsigned int)m_ownedLandmarks.size();
+	m_ownedDistances.resize((size_t)numNodes * count);
+	for (unsigned int v = 0; v < numNodes; v++) {
+		for (unsigned int i = 0; i < count; i++) {
+			m_ownedDistances[(size_t)v * count + i] = (float)fromLandmark[i][v];
+		}
+	}
+	bind();
+}
+
+bool LandmarkTable::attach(const StreetGraph& g) {
+	clear();
+	SnapshotSection nodes, distances;
+	if (!g.findSnapshotSection(SECTION_LANDMARK_NODES, nodes) || !g.findSnapshotSection(SECTION_LANDMARK_DISTANCES, distances)) {
+		return false;
+	}
+	  // sizes are compared by division, so a huge landmark count can't wrap the product
+	size_t count = nodes.size / sizeof(unsigned int);
+	if (count == 0 || count > g.numNodes() || nodes.size != count * sizeof(unsigned int) ||
+		distances.size % (count * sizeof(float)) != 0 || distances.size / (count * sizeof(float)) != g.numNodes()) {
+		return false;
+	}
+	m_numNodes = g.numNodes();
+	m_numLandmarks = (unsigned int)count;
+	m_landmarks = reinterpret_cast<const unsigned int*>(nodes.data);
+	m_distances = reinterpret_cast<const float*>(distances.data);
+	if (!validate()) {
+		std::cerr << "The map snapshot's landmark table is corrupt; routing without it" << endl;
+		clear();
+		return false;
+	}
+	return true;
+}
+
+bool LandmarkTable::validate() const {
+	for (unsigned int i = 0; i < m_numLandmarks; i++) {
+		if (m_landmarks[i] >= m_numNodes || m_distances[(size_t)m_landmarks[i] * m_numLandmarks + i] != 0) {
+			return false; // not a node, or not at distance 0 from itself
+		}
+	}
+	size_t size = (size_t)m_numNodes * m_numLandmarks;
+	for (size_t k = 0; k < size; k++) {
+		if (!(m_distances[k] >= 0)) { // negative or NaN; unreachable nodes are +infinity
+			return false;
+		}
+	}
+	return true;
+}
+
+vector<SnapshotSection> LandmarkTable::snapshotSections() const {
+	vector<SnapshotSection> sections;
+	if (empty()) {
+		return sections;
+	}
+	SnapshotSection s;
+	s.id = SECTION_LANDMARK_NODES;
+	s.data = reinterpret_cast<const char*>(m_landmarks);
+	s.size = m_numLandmarks * sizeof(unsigned int);
+	sections.push_back(s);
+	s.id = SECTION_LANDMARK_DISTANCES;
+	s.data = reinterpret_cast<const char*>(m_distances);
+	s.size = (size_t)m_numNodes * m_numLandmarks * sizeof(float);
+	sections.push_back(s);
+	return sections;
+}
+
+double LandmarkTable::lowerBound(unsigned int node, unsigned int target) const {
+	const float* dv = m_distances + (size_t)node * m_numLandmarks;
+	const float* dt = m_distances + (size_t)target * m_numLandmarks;
+	double best = 0;
+	for (unsigned int i = 0; i < m_numLandmarks; i++) {
+		double a = dv[i];
+		double b = dt[i];
+		if (isinf(a) || isinf(b)) { // the landmark can't see one of them, so it says nothing
+			continue;
+		}
+		best = max(best, fabs(a - b) - (a + b) * FLOAT_SLACK);
+	}
+	return best;
+}
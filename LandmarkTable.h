@@ -0,0 +1,65 @@
+#ifndef LANDMARKTABLE_INCLUDED
+#define LANDMARKTABLE_INCLUDED
+
+#include "StreetGraph.h"
+#include <vector>
+
+// Snapshot sections that hold landmark distances next to the map they belong to
+enum LandmarkTableSection
+{
+	SECTION_LANDMARK_NODES = 19, SECTION_LANDMARK_DISTANCES
+};
+
+// Distances from a few landmark nodes to every node, for the ALT heuristic
+// (A*, Landmarks, Triangle inequality). Streets are two-way, so for any landmark
+// L, dist(v, t) >= |dist(L, t) - dist(L, v)|; the best such bound over all
+// landmarks is a far tighter lower bound than straight-line distance wherever
+// the road network detours around rivers, freeways or dead ends.
+//
+// Landmarks are picked either farthest-first (each one as far as possible from
+// those already chosen) or by the avoid rule, which grows a shortest path tree
+// from a node far from the current landmarks and descends toward the subtree
+// whose distances the current landmarks bound worst. Distances are stored as
+// floats, node-major (all of a node's landmark distances sit together), and the
+// bound is shaved by the float rounding error so it never overestimates.
+class LandmarkTable
+{
+public:
+	LandmarkTable();
+	void clear();
+	bool empty() const { return m_numLandmarks == 0; }
+
+	  // choose count landmarks in g and compute their distance tables
+	void build(const StreetGraph& g, unsigned int count, LandmarkSelection selection);
+	  // use a table stored in g's snapshot in place; false (and empty) if there
+	  // isn't one or it doesn't fit g
+	bool attach(const StreetGraph& g);
+	  // the sections to store in a snapshot to get this table back with attach()
+	std::vector<SnapshotSection> snapshotSections() const;
+
+	unsigned int numLandmarks() const { return m_numLandmarks; }
+	unsigned int landmark(unsigned int i) const { return m_landmarks[i]; }
+
+	  // a lower bound on the road distance between two nodes
+	double lowerBound(unsigned int node, unsigned int target) const;
+
+	  // We prevent a LandmarkTable object from being copied or assigned.
+	LandmarkTable(const LandmarkTable&) = delete;
+	LandmarkTable& operator=(const LandmarkTable&) = delete;
+
+private:
+	void bind();
+	  // check attached landmarks and distances against the graph's node count
+	bool validate() const;
+
+	std::vector<unsigned int> m_ownedLandmarks;
+	std::vector<float> m_ownedDistances;
+
+	  // views over either the owned arrays or a mapped snapshot
+	unsigned int m_numNodes;
+	unsigned int m_numLandmarks;
+	const unsigned int* m_landmarks;
+	const float* m_distances; // m_distances[node * m_numLandmarks + i]; infinite if unreachable
+};
+
+#endif // LANDMARKTABLE_INCLUDED
@@ -0,0 +1,174 @@
+#include "LargeTour.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// stands in for an edge a path must not use (and for missing routes), large
+// enough that no solver keeps it, small enough that sums stay exact to a foot
+static const double FORBIDDEN = 1e9;
+
+// the Hilbert curve is laid over a 2^16 x 2^16 grid on the points' bounding box
+static const unsigned int HILBERT_SIDE = 1u << 16;
+
+  // distance along the Hilbert curve of grid cell (x, y)
+static unsigned long long hilbertIndex(unsigned int x, unsigned int y)
+{
+	unsigned long long d = 0;
+	for (unsigned int s = HILBERT_SIDE / 2; s > 0; s /= 2) {
+		unsigned int rx = (x & s) ? 1 : 0;
+		unsigned int ry = (y & s) ? 1 : 0;
+		d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+		if (ry == 0) { // rotate the quadrant so the curve inside it runs the standard way
+			if (rx == 1) {
+				x = HILBERT_SIDE - 1 - x;
+				y = HILBERT_SIDE - 1 - y;
+			}
+			swap(x, y);
+		}
+	}
+	return d;
+}
+
+  // run task(0..count-1) on up to numThreads threads, handing out one index at a time
+template<class Task>
+static void parallelFor(unsigned int count, unsigned int numThreads, Task task)
+{
+	numThreads = max(1u, min(numThreads, count));
+	atomic<unsigned int> next(0);
+	auto work = [&]() {
+		for (unsigned int i = next++; i < count; i = next++) {
+			task(i);
+		}
+	};
+	if (numThreads == 1) {
+		work();
+		return;
+	}
+	vector<thread> workers;
+	for (unsigned int i = 0; i < numThreads; i++) {
+		workers.push_back(thread(work));
+	}
+	for (thread& t : workers) {
+		t.join();
+	}
+}
+
+// Reorder path (point indices) into a short path that still starts at its first
+// point and ends at its last. A made-up point 0 is joined to both ends at no
+// cost and forbidden next to anything else, which turns the path into a tour
+// the small-tour solver can work on.
+static void optimizePath(vector<unsigned int>& path, const PointCosts& costs, const SubTourSolver& solveSmall)
+{
+	unsigned int m = (unsigned int)path.size();
+	if (m <= 3) {
+		return; // nothing between the ends to rearrange
+	}
+	DistanceMatrix local;
+	local.computeWith(m + 1, [&](unsigned int i, unsigned int j) -> double {
+		if (i == j) {
+			return 0;
+		}
+		if (i == 0 || j == 0) {
+			unsigned int other = max(i, j) - 1;
+			return (other == 0 || other == m - 1) ? 0 : FORBIDDEN;
+		}
+		if ((i == 1 && j == m) || (i == m && j == 1)) {
+			return FORBIDDEN; // the ends must not meet directly
+		}
+		double c = costs(path[i - 1], path[j - 1]);
+		return isfinite(c) ? min(c, FORBIDDEN) : FORBIDDEN;
+	});
+	vector<unsigned int> order;
+	for (unsigned int i = 1; i <= m; i++) {
+		order.push_back(i);
+	}
+	solveSmall(order, local);
+	if (order.back() == 1) { // the solver may hand the tour back the other way round
+		reverse(order.begin(), order.end());
+	}
+	if (order.front() != 1 || order.back() != m) {
+		return; // the ends came loose, which only a forbidden edge could do; keep the old path
+	}
+	vector<unsigned int> result;
+	for (unsigned int i : order) {
+		result.push_back(path[i - 1]);
+	}
+	path.swap(result);
+}
+
+double optimizeLargeTour(vector<unsigned int>& order, const vector<double>& latitudes,
+                         const vector<double>& longitudes, const PointCosts& costs,
+                         unsigned int clusterSize, unsigned int numThreads, const SubTourSolver& solveSmall)
+{
+	// 1. the depot and the stops in Hilbert order, rotated to start at the depot
+	vector<unsigned int> cycle(1, 0);
+	cycle.insert(cycle.end(), order.begin(), order.end());
+	unsigned int n = (unsigned int)cycle.size();
+	double minLat = latitudes[0], maxLat = latitudes[0], minLon = longitudes[0], maxLon = longitudes[0];
+	for (unsigned int p : cycle) {
+		minLat = min(minLat, latitudes[p]);
+		maxLat = max(maxLat, latitudes[p]);
+		minLon = min(minLon, longitudes[p]);
+		maxLon = max(maxLon, longitudes[p]);
+	}
+	double latScale = (maxLat > minLat) ? (HILBERT_SIDE - 1) / (maxLat - minLat) : 0;
+	double lonScale = (maxLon > minLon) ? (HILBERT_SIDE - 1) / (maxLon - minLon) : 0;
+	vector<pair<unsigned long long, unsigned int> > keyed;
+	for (unsigned int p : cycle) {
+		unsigned int x = (unsigned int)((longitudes[p] - minLon) * lonScale);
+		unsigned int y = (unsigned int)((latitudes[p] - minLat) * latScale);
+		keyed.push_back(make_pair(hilbertIndex(x, y), p));
+	}
+	sort(keyed.begin(), keyed.end()); // ties by point index, so the order is deterministic
+	unsigned int depotAt = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		cycle[i] = keyed[i].second;
+		if (cycle[i] == 0) {
+			depotAt = i;
+		}
+	}
+	rotate(cycle.begin(), cycle.begin() + depotAt, cycle.end());
+
+	// 2. balanced clusters of consecutive stops, each reordered between its fixed ends
+	unsigned int numStops = n - 1;
+	clusterSize = max(clusterSize, 8u);
+	unsigned int numClusters = max(1u, (numStops + clusterSize - 1) / clusterSize);
+	vector<unsigned int> starts; // cycle position where each cluster begins
+	for (unsigned int c = 0; c <= numClusters; c++) {
+		starts.push_back(1 + (unsigned int)((unsigned long long)numStops * c / numClusters));
+	}
+	parallelFor(numClusters, numThreads, [&](unsigned int c) {
+		vector<unsigned int> path(cycle.begin() + starts[c], cycle.begin() + starts[c + 1]);
+		optimizePath(path, costs, solveSmall);
+		copy(path.begin(), path.end(), cycle.begin() + starts[c]);
+	});
+
+	// 3. windows over each join, half a (smallest) cluster on either side; they
+	// don't overlap, so they can be solved in parallel too
+	unsigned int halfWindow = (numStops / numClusters) / 2;
+	if (numClusters > 1 && halfWindow >= 2) {
+		parallelFor(numClusters, numThreads, [&](unsigned int c) {
+			unsigned int first = (starts[c] + n - halfWindow) % n;
+			vector<unsigned int> path;
+			for (unsigned int k = 0; k < 2 * halfWindow; k++) {
+				path.push_back(cycle[(first + k) % n]);
+			}
+			optimizePath(path, costs, solveSmall);
+			for (unsigned int k = 0; k < 2 * halfWindow; k++) {
+				cycle[(first + k) % n] = path[k];
+			}
+		});
+	}
+
+	// the depot may have moved inside its window; start the tour there again
+	rotate(cycle.begin(), find(cycle.begin(), cycle.end(), 0u), cycle.end());
+	order.assign(cycle.begin() + 1, cycle.end());
+	double length = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		length += costs(cycle[i], cycle[(i + 1) % n]);
+	}
+	return length;
+}
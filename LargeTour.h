@@ -0,0 +1,32 @@
+#ifndef LARGETOUR_INCLUDED
+#define LARGETOUR_INCLUDED
+
+#include "DistanceMatrix.h"
+#include <vector>
+#include <functional>
+
+// cost between two points of a tour, by point index (the depot is point 0)
+typedef std::function<double(unsigned int, unsigned int)> PointCosts;
+// improves a small tour over a cost matrix in place (DeliveryOptimizer's own search)
+typedef std::function<void(std::vector<unsigned int>&, const DistanceMatrix&)> SubTourSolver;
+
+// Sequencing for manifests too large for one cost matrix (10k+ stops), in time
+// close to linear in the number of stops:
+//
+//  1. Sort the stops and the depot along a Hilbert curve over their coordinates.
+//     Points close on the curve are close on the map, so this is already a fair
+//     tour, and rotating it to start at the depot makes it a depot tour.
+//  2. Cut the curve into clusters of about clusterSize consecutive stops and
+//     reorder each one in parallel as a path whose two ends stay put, so the
+//     clusters still join up the way the curve did.
+//  3. Re-solve a window straddling each join between clusters (the depot's join
+//     included), again as fixed-end paths, so stops near a border can move across it.
+//
+// Each cluster and window is solved by solveSmall over its own small matrix, and
+// only costs between points of the same cluster or window are ever asked for.
+// Returns the tour's length; order holds points 1..n, as in DeliveryOptimizer.
+double optimizeLargeTour(std::vector<unsigned int>& order, const std::vector<double>& latitudes,
+                         const std::vector<double>& longitudes, const PointCosts& costs,
+                         unsigned int clusterSize, unsigned int numThreads, const SubTourSolver& solveSmall);
+
+#endif // LARGETOUR_INCLUDED
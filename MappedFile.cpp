@@ -0,0 +1,64 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+MappedFile::MappedFile() {
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const string& fileName) {
+	close();
+#if !defined(_WIN32)
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			::close(fd); // the mapping stays valid after the descriptor is closed
+			madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+			m_data = static_cast<const char*>(p);
+			m_size = (size_t)st.st_size;
+			m_mapped = true;
+			return true;
+		}
+	}
+	::close(fd); // empty or unmappable (e.g. a pipe), so fall back to reading it
+#endif
+	ifstream in(fileName, ios::binary);
+	if (!in) {
+		return false;
+	}
+	m_buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+	return true;
+}
+
+void MappedFile::close() {
+#if !defined(_WIN32)
+	if (m_mapped) {
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+#endif
+	m_buffer.clear();
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_INCLUDED
+#define MAPPEDFILE_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Read-only view of a whole file. On POSIX systems the file is mmapped so the
+// loaders can parse it in place; elsewhere it is read into one buffer.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	bool open(const std::string& fileName);
+	void close();
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	  // We prevent a MappedFile object from being copied or assigned.
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+	const char* m_data;
+	size_t m_size;
+	bool m_mapped;
+	std::vector<char> m_buffer; // only used when the file couldn't be mapped
+};
+
+#endif // MAPPEDFILE_INCLUDED
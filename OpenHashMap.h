@@ -0,0 +1,317 @@
+#ifndef OPENHASHMAP
+#define OPENHASHMAP
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "HashPolicy.h"
+
+// An open-addressing (Robin Hood, linear probing) counterpart to
+// ExpandableHashMap with the same associate/find/reset/size surface.
+// Entries live in one flat array next to their cached 32-bit hash, so a probe
+// compares hashes before it ever touches a key. Robin Hood placement keeps probe
+// sequences short, and lets a miss stop as soon as it passes where its key
+// would have been placed.
+//
+// With incremental rehashing on, growing the table doesn't move every entry at
+// once: the old array is kept and a few of its slots are moved on each later
+// insertion, and lookups check both arrays until it's drained.
+//
+// Pointers returned by find/try_emplace are invalidated by the next insertion.
+// Hash and KeyEqual are the same policy types ExpandableHashMap takes.
+template<typename KeyType, typename ValueType,
+         typename Hash = DefaultHash<KeyType>, typename KeyEqual = DefaultEqual<KeyType> >
+class OpenHashMap
+{
+public:
+	OpenHashMap(double maximumLoadFactor = 0.75, bool incrementalRehash = false);
+	~OpenHashMap();
+	void reset();
+	int size() const;
+	void reserve(int numValues);
+
+	  // insert key, or overwrite its value if it is already there
+	void associate(const KeyType& key, const ValueType& value);
+	void associate(KeyType&& key, ValueType&& value);
+
+	  // insert key with a value built from args unless it is already there; returns
+	  // the stored value and whether it was inserted (like std::unordered_map)
+	template<typename... Args>
+	std::pair<ValueType*, bool> try_emplace(const KeyType& key, Args&&... args);
+	template<typename... Args>
+	std::pair<ValueType*, bool> try_emplace(KeyType&& key, Args&&... args);
+	std::pair<ValueType*, bool> emplace(KeyType&& key, ValueType&& value)
+	{
+		return try_emplace(std::move(key), std::move(value));
+	}
+
+	  // for a map that can't be modified, return a pointer to const ValueType
+	const ValueType* find(const KeyType& key) const;
+
+	  // for a modifiable map, return a pointer to modifiable ValueType
+	ValueType* find(const KeyType& key)
+	{
+		return const_cast<ValueType*>(const_cast<const OpenHashMap*>(this)->find(key));
+	}
+
+	  // C++11 syntax for preventing copying and assignment
+	OpenHashMap(const OpenHashMap&) = delete;
+	OpenHashMap& operator=(const OpenHashMap&) = delete;
+
+private:
+	  // hash values 0 and 1 are reserved to mark slots
+	static const unsigned int EMPTY = 0;
+	static const unsigned int MOVED = 1; // only in the old array during a rehash
+
+	struct Slot {
+		unsigned int hash;
+		KeyType key;
+		ValueType val;
+	};
+
+	struct Table {
+		std::vector<Slot> slots;
+		unsigned int mask;
+	};
+
+	static unsigned int hashOf(const KeyType& key);
+	static unsigned int probeDistance(const Table& t, unsigned int hash, unsigned int slot)
+	{
+		return (slot - (hash & t.mask)) & t.mask;
+	}
+	static void allocate(Table& t, unsigned int numSlots);
+	static Slot* lookup(const Table& t, const KeyType& key, unsigned int hash);
+	static Slot* place(Table& t, Slot&& s);
+	template<typename K, typename... Args>
+	std::pair<ValueType*, bool> insert(K&& key, Args&&... args);
+	void migrate(unsigned int numSlots);
+	void grow();
+
+	int numVals;
+	double maxLoad;
+	bool incremental;
+	unsigned int migrateStep; // old slots moved per insertion during a rehash
+	Table table;
+	Table old;            // being drained into table; empty when no rehash is in progress
+	unsigned int oldNext; // next slot of old to move
+};
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::OpenHashMap(double maximumLoadFactor, bool incrementalRehash) {
+	if (maximumLoadFactor > 0 && maximumLoadFactor <= 0.95) {
+		maxLoad = maximumLoadFactor;
+	}
+	else {
+		maxLoad = 0.75;
+	}
+	incremental = incrementalRehash;
+	  // growth happens again after maxLoad * oldSize insertions, so moving a bit
+	  // more than 1 / maxLoad slots each time always drains old before then
+	migrateStep = (unsigned int)(1 / maxLoad) + 2;
+	numVals = 0;
+	oldNext = 0;
+	allocate(table, 8);
+	old.mask = 0;
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::~OpenHashMap() {
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::reset() {
+	numVals = 0;
+	oldNext = 0;
+	allocate(table, 8);
+	std::vector<Slot>().swap(old.slots);
+	old.mask = 0;
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+int OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::size() const {
+	return numVals;
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::reserve(int numValues) {
+	migrate((unsigned int)old.slots.size()); // finish any rehash in progress first
+	unsigned int numSlots = (unsigned int)table.slots.size();
+	while (numValues > maxLoad * numSlots) {
+		numSlots *= 2;
+	}
+	if (numSlots == table.slots.size()) {
+		return;
+	}
+	Table bigger;
+	allocate(bigger, numSlots);
+	for (Slot& s : table.slots) {
+		if (s.hash != EMPTY) {
+			place(bigger, std::move(s));
+		}
+	}
+	table.slots.swap(bigger.slots);
+	table.mask = bigger.mask;
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::associate(const KeyType& key, const ValueType& value) {
+	std::pair<ValueType*, bool> r = insert(key, value);
+	if (!r.second) { // the key already existed, so update the value
+		*r.first = value;
+	}
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::associate(KeyType&& key, ValueType&& value) {
+	std::pair<ValueType*, bool> r = insert(std::move(key), std::move(value));
+	if (!r.second) {
+		*r.first = std::move(value); // not moved from when nothing was inserted
+	}
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+template<typename... Args>
+std::pair<ValueType*, bool> OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::try_emplace(const KeyType& key, Args&&... args) {
+	return insert(key, std::forward<Args>(args)...);
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+template<typename... Args>
+std::pair<ValueType*, bool> OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::try_emplace(KeyType&& key, Args&&... args) {
+	return insert(std::move(key), std::forward<Args>(args)...);
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+const ValueType* OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::find(const KeyType& key) const {
+	unsigned int hash = hashOf(key);
+	Slot* s = lookup(table, key, hash);
+	if (s == nullptr && !old.slots.empty()) { // not moved over yet
+		s = lookup(old, key, hash);
+	}
+	return s == nullptr ? nullptr : &s->val;
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+unsigned int OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::hashOf(const KeyType& key) {
+	unsigned int h = Hash()(key);
+	return h < 2 ? h + 2 : h; // keep clear of the EMPTY and MOVED markers
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::allocate(Table& t, unsigned int numSlots) {
+	std::vector<Slot>(numSlots).swap(t.slots); // every hash starts out EMPTY
+	for (Slot& s : t.slots) {
+		s.hash = EMPTY;
+	}
+	t.mask = numSlots - 1;
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+typename OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::Slot* OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::lookup(const Table& t, const KeyType& key, unsigned int hash) {
+	unsigned int slot = hash & t.mask;
+	for (unsigned int dist = 0; ; dist++) {
+		const Slot& s = t.slots[slot];
+		if (s.hash == EMPTY) {
+			return nullptr;
+		}
+		if (s.hash == hash && KeyEqual()(s.key, key)) { // compare cached hashes before keys
+			return const_cast<Slot*>(&s);
+		}
+		if (s.hash != MOVED && probeDistance(t, s.hash, slot) < dist) {
+			return nullptr; // Robin Hood: key would have displaced this entry
+		}
+		slot = (slot + 1) & t.mask;
+	}
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+typename OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::Slot* OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::place(Table& t, Slot&& s) {
+	// walk the probe sequence, swapping the travelling entry with any richer one
+	Slot* result = nullptr;
+	unsigned int slot = s.hash & t.mask;
+	unsigned int dist = 0;
+	for (;;) {
+		Slot& here = t.slots[slot];
+		if (here.hash == EMPTY) {
+			here = std::move(s);
+			return result != nullptr ? result : &here;
+		}
+		unsigned int hereDist = probeDistance(t, here.hash, slot);
+		if (hereDist < dist) {
+			std::swap(here, s);
+			if (result == nullptr) {
+				result = &here; // the new entry settles at its first swap
+			}
+			dist = hereDist;
+		}
+		slot = (slot + 1) & t.mask;
+		dist++;
+	}
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+template<typename K, typename... Args>
+std::pair<ValueType*, bool> OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::insert(K&& key, Args&&... args) {
+	if (incremental) {
+		migrate(migrateStep);
+	}
+	unsigned int hash = hashOf(key);
+	Slot* s = lookup(table, key, hash);
+	if (s == nullptr && !old.slots.empty()) {
+		s = lookup(old, key, hash);
+	}
+	if (s != nullptr) {
+		return std::make_pair(&s->val, false);
+	}
+
+	if (numVals + 1 > maxLoad * table.slots.size()) { // grow before placing so the pointer stays valid
+		grow();
+	}
+	Slot n;
+	n.hash = hash;
+	n.key = std::forward<K>(key);
+	n.val = ValueType(std::forward<Args>(args)...);
+	numVals++;
+	return std::make_pair(&place(table, std::move(n))->val, true);
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::migrate(unsigned int numSlots) {
+	while (numSlots > 0 && oldNext < old.slots.size()) {
+		Slot& s = old.slots[oldNext++];
+		if (s.hash != EMPTY && s.hash != MOVED) {
+			place(table, std::move(s));
+			s.hash = MOVED; // leave a marker so later probes in old keep going
+		}
+		numSlots--;
+	}
+	if (!old.slots.empty() && oldNext == old.slots.size()) {
+		std::vector<Slot>().swap(old.slots);
+		old.mask = 0;
+		oldNext = 0;
+	}
+}
+
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+void OpenHashMap<KeyType, ValueType, Hash, KeyEqual>::grow() {
+	migrate((unsigned int)old.slots.size()); // a rehash still in progress has to finish first
+	Table bigger;
+	allocate(bigger, (unsigned int)table.slots.size() * 2);
+	if (incremental) { // keep the current array around and drain it a few slots at a time
+		old.slots.swap(table.slots);
+		old.mask = table.mask;
+		oldNext = 0;
+		table.slots.swap(bigger.slots);
+		table.mask = bigger.mask;
+		return;
+	}
+	for (Slot& s : table.slots) { // move everything over now
+		if (s.hash != EMPTY) {
+			place(bigger, std::move(s));
+		}
+	}
+	table.slots.swap(bigger.slots);
+	table.mask = bigger.mask;
+}
+
+#endif
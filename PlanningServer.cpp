@@ -0,0 +1,657 @@
+#include "PlanningServer.h"
+#include "RouteCache.h"
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+#endif
+using namespace std;
+
+  // the most a single request may ask of the optimizer
+static const unsigned int MAX_REQUEST_CHAINS = 64;
+static const double MAX_REQUEST_SECONDS = 3600;
+static const double MAX_REQUEST_SNAP_MILES = 10;
+
+// Just enough JSON for the request lines: numbers are kept as their text, so
+// coordinates can be passed on to GeoCoord exactly as written.
+struct JsonValue
+{
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+	JsonValue() : type(NUL) {}
+
+	  // the member called name, or nullptr if this isn't an object or has none
+	const JsonValue* member(const string& name) const
+	{
+		for (const pair<string, JsonValue>& m : members) {
+			if (m.first == name) {
+				return &m.second;
+			}
+		}
+		return nullptr;
+	}
+	  // a string's characters or a number's text; empty for anything else
+	string scalar() const { return (type == STRING || type == NUMBER) ? text : ""; }
+
+	Type type;
+	string text;                               // STRING, NUMBER, BOOLEAN ("true"/"false")
+	vector<JsonValue> items;                   // ARRAY
+	vector<pair<string, JsonValue> > members;  // OBJECT, in the order given
+};
+
+class JsonReader
+{
+public:
+	JsonReader(const string& text) : m_text(text), m_pos(0) {}
+
+	  // parse the whole text as one value; false if it isn't valid JSON
+	bool parse(JsonValue& value)
+	{
+		return parseValue(value, 0) && (skipSpace(), m_pos == m_text.size());
+	}
+
+private:
+	static const unsigned int MAX_DEPTH = 64;
+
+	void skipSpace()
+	{
+		while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\r' || m_text[m_pos] == '\n')) {
+			m_pos++;
+		}
+	}
+
+	bool literal(const char* word)
+	{
+		size_t length = strlen(word);
+		if (m_text.compare(m_pos, length, word) != 0) {
+			return false;
+		}
+		m_pos += length;
+		return true;
+	}
+
+	bool parseValue(JsonValue& value, unsigned int depth)
+	{
+		skipSpace();
+		if (m_pos == m_text.size() || depth > MAX_DEPTH) {
+			return false;
+		}
+		char c = m_text[m_pos];
+		if (c == '{') {
+			value.type = JsonValue::OBJECT;
+			m_pos++;
+			skipSpace();
+			if (m_pos < m_text.size() && m_text[m_pos] == '}') {
+				m_pos++;
+				return true;
+			}
+			for (;;) {
+				skipSpace();
+				pair<string, JsonValue> m;
+				if (m_pos == m_text.size() || m_text[m_pos] != '"' || !parseString(m.first)) {
+					return false;
+				}
+				skipSpace();
+				if (m_pos == m_text.size() || m_text[m_pos++] != ':' || !parseValue(m.second, depth + 1)) {
+					return false;
+				}
+				value.members.push_back(m);
+				skipSpace();
+				if (m_pos == m_text.size()) {
+					return false;
+				}
+				if (m_text[m_pos] == '}') {
+					m_pos++;
+					return true;
+				}
+				if (m_text[m_pos++] != ',') {
+					return false;
+				}
+			}
+		}
+		if (c == '[') {
+			value.type = JsonValue::ARRAY;
+			m_pos++;
+			skipSpace();
+			if (m_pos < m_text.size() && m_text[m_pos] == ']') {
+				m_pos++;
+				return true;
+			}
+			for (;;) {
+				value.items.push_back(JsonValue());
+				if (!parseValue(value.items.back(), depth + 1)) {
+					return false;
+				}
+				skipSpace();
+				if (m_pos == m_text.size()) {
+					return false;
+				}
+				if (m_text[m_pos] == ']') {
+					m_pos++;
+					return true;
+				}
+				if (m_text[m_pos++] != ',') {
+					return false;
+				}
+			}
+		}
+		if (c == '"') {
+			value.type = JsonValue::STRING;
+			return parseString(value.text);
+		}
+		if (literal("true") || literal("false")) {
+			value.type = JsonValue::BOOLEAN;
+			value.text = (c == 't') ? "true" : "false";
+			return true;
+		}
+		if (literal("null")) {
+			value.type = JsonValue::NUL;
+			return true;
+		}
+		size_t start = m_pos;
+		while (m_pos < m_text.size() && strchr("+-0123456789.eE", m_text[m_pos]) != nullptr) {
+			m_pos++;
+		}
+		if (m_pos == start) {
+			return false;
+		}
+		value.type = JsonValue::NUMBER;
+		value.text = m_text.substr(start, m_pos - start);
+		return true;
+	}
+
+	  // a quoted string starting at m_pos; \u escapes are decoded to UTF-8
+	bool parseString(string& s)
+	{
+		m_pos++; // opening quote
+		while (m_pos < m_text.size()) {
+			char c = m_text[m_pos++];
+			if (c == '"') {
+				return true;
+			}
+			if (c != '\\') {
+				s += c;
+				continue;
+			}
+			if (m_pos == m_text.size()) {
+				return false;
+			}
+			c = m_text[m_pos++];
+			switch (c) {
+			case 'n': s += '\n'; break;
+			case 't': s += '\t'; break;
+			case 'r': s += '\r'; break;
+			case 'b': s += '\b'; break;
+			case 'f': s += '\f'; break;
+			case 'u': {
+				if (m_pos + 4 > m_text.size()) {
+					return false;
+				}
+				unsigned int code = (unsigned int)strtoul(m_text.substr(m_pos, 4).c_str(), nullptr, 16);
+				m_pos += 4;
+				if (code < 0x80) {
+					s += (char)code;
+				}
+				else if (code < 0x800) {
+					s += (char)(0xC0 | (code >> 6));
+					s += (char)(0x80 | (code & 0x3F));
+				}
+				else {
+					s += (char)(0xE0 | (code >> 12));
+					s += (char)(0x80 | ((code >> 6) & 0x3F));
+					s += (char)(0x80 | (code & 0x3F));
+				}
+				break;
+			}
+			default: s += c; break; // \" \\ \/
+			}
+		}
+		return false;
+	}
+
+	const string& m_text;
+	size_t m_pos;
+};
+
+  // s as a quoted JSON string
+static string jsonString(const string& s)
+{
+	string out = "\"";
+	for (char c : s) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)(unsigned char)c);
+				out += escaped;
+			}
+			else {
+				out += c;
+			}
+		}
+	}
+	return out + "\"";
+}
+
+  // the id to echo back: a number as written, anything else as a string
+static string jsonId(const JsonValue* id)
+{
+	if (id == nullptr) {
+		return "null";
+	}
+	return (id->type == JsonValue::NUMBER) ? id->text : jsonString(id->scalar());
+}
+
+static string errorLine(const string& id, const string& error, const string& message)
+{
+	return "{\"id\": " + id + ", \"status\": \"error\", \"error\": " + jsonString(error) +
+		", \"message\": " + jsonString(message) + "}";
+}
+
+  // a point given as [lat, lon] or {"lat": ..., "lon": ...}; false unless both
+  // are numbers, so GeoCoord never sees text it would throw on
+static bool readCoord(const JsonValue* v, GeoCoord& coord)
+{
+	if (v == nullptr) {
+		return false;
+	}
+	string lat, lon;
+	if (v->type == JsonValue::ARRAY && v->items.size() == 2) {
+		lat = v->items[0].scalar();
+		lon = v->items[1].scalar();
+	}
+	else if (v->type == JsonValue::OBJECT && v->member("lat") != nullptr && v->member("lon") != nullptr) {
+		lat = v->member("lat")->scalar();
+		lon = v->member("lon")->scalar();
+	}
+	if (!isCoordText(lat) || !isCoordText(lon)) {
+		return false;
+	}
+	coord = GeoCoord(lat, lon);
+	return true;
+}
+
+  // text as a whole number with no sign; false for anything else
+static bool readWhole(const string& text, unsigned long long& value)
+{
+	if (text.empty() || text.size() > 19 || text.find_first_not_of("0123456789") != string::npos) {
+		return false;
+	}
+	value = strtoull(text.c_str(), nullptr, 10);
+	return true;
+}
+
+  // apply the request's "options" object; false (with the reason) on a bad one.
+  // A request may ask for fewer threads than the machine has, never more, and
+  // for a bounded number of chains, so one client can't swamp the server.
+static bool readOptions(const JsonValue* v, OptimizerOptions& options, double& maxSnapMiles, string& message)
+{
+	if (v == nullptr) {
+		return true;
+	}
+	if (v->type != JsonValue::OBJECT) {
+		message = "options must be an object";
+		return false;
+	}
+	for (const pair<string, JsonValue>& m : v->members) {
+		const string& name = m.first;
+		const string& text = m.second.text;
+		if (name == "method") {
+			if (text == "anneal") {
+				options.method = OPTIMIZE_ANNEAL;
+			}
+			else if (text == "local") {
+				options.method = OPTIMIZE_LOCAL_SEARCH;
+			}
+			else if (text == "anneal+local") {
+				options.method = OPTIMIZE_ANNEAL_THEN_LOCAL_SEARCH;
+			}
+			else {
+				message = "unknown method " + text;
+				return false;
+			}
+			continue;
+		}
+		if (m.second.type != JsonValue::NUMBER) {
+			message = "option " + name + " must be a number";
+			return false;
+		}
+		unsigned long long whole;
+		if (name == "maxSnapMiles") {
+			char* end;
+			double miles = strtod(text.c_str(), &end);
+			if (*end != '\0' || !(miles >= 0 && miles <= MAX_REQUEST_SNAP_MILES)) {
+				message = "option maxSnapMiles must be a number of miles from 0 to " + to_string((int)MAX_REQUEST_SNAP_MILES);
+				return false;
+			}
+			maxSnapMiles = miles;
+		}
+		else if (name == "timeLimit") {
+			char* end;
+			double seconds = strtod(text.c_str(), &end);
+			if (*end != '\0' || !(seconds >= 0 && seconds <= MAX_REQUEST_SECONDS)) {
+				message = "option timeLimit must be a number of seconds from 0 to " + to_string((int)MAX_REQUEST_SECONDS);
+				return false;
+			}
+			options.timeLimit = seconds;
+		}
+		else if (name == "maxEvaluations" || name == "seed") {
+			if (!readWhole(text, whole)) {
+				message = "option " + name + " must be a whole number";
+				return false;
+			}
+			if (name == "seed") {
+				options.seed = whole;
+			}
+			else {
+				options.maxEvaluations = whole;
+			}
+		}
+		else if (name == "numChains" || name == "numThreads") {
+			if (!readWhole(text, whole) || whole == 0) {
+				message = "option " + name + " must be a positive whole number";
+				return false;
+			}
+			if (name == "numChains") {
+				options.numChains = (unsigned int)min<unsigned long long>(whole, MAX_REQUEST_CHAINS);
+			}
+			else {
+				options.numThreads = (unsigned int)min<unsigned long long>(whole, max(1u, thread::hardware_concurrency()));
+			}
+		}
+		else {
+			message = "unknown option " + name;
+			return false;
+		}
+	}
+	return true;
+}
+
+  // Standard output (or any stream) shared by every worker
+class StreamSink : public PlanningServer::ResultSink
+{
+public:
+	StreamSink(ostream& out) : m_out(out) {}
+	void writeLine(const string& line)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_out << line << '\n';
+		m_out.flush();
+	}
+private:
+	ostream& m_out;
+	mutex m_mutex;
+};
+
+#if !defined(_WIN32)
+  // One socket client; the connection closes once its last result is written
+class SocketSink : public PlanningServer::ResultSink
+{
+public:
+	SocketSink(int fd) : m_fd(fd) {}
+	~SocketSink() { close(m_fd); }
+	void writeLine(const string& line)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		string data = line + '\n';
+		size_t sent = 0;
+		while (sent < data.size()) {
+			ssize_t n = write(m_fd, data.data() + sent, data.size() - sent);
+			if (n <= 0) {
+				return; // the client went away; its remaining results are dropped
+			}
+			sent += (size_t)n;
+		}
+	}
+	int fd() const { return m_fd; }
+private:
+	int m_fd;
+	mutex m_mutex;
+};
+#endif
+
+PlanningServer::PlanningServer(const StreetMap* sm, unsigned int numWorkers, unsigned int queueCapacity, double maxSnapMiles)
+ : m_map(sm), m_capacity(max(1u, queueCapacity)), m_maxSnapMiles(maxSnapMiles), m_busy(0), m_stopping(false)
+{
+	if (numWorkers == 0) {
+		numWorkers = max(1u, thread::hardware_concurrency());
+	}
+	m_threadsPerPlan = max(1u, thread::hardware_concurrency() / numWorkers);
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		m_workers.push_back(thread(&PlanningServer::work, this));
+	}
+}
+
+PlanningServer::~PlanningServer()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_notEmpty.notify_all();
+	for (thread& t : m_workers) {
+		t.join();
+	}
+}
+
+void PlanningServer::submit(const string& request, const shared_ptr<ResultSink>& sink)
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_notFull.wait(lock, [&]() { return m_queue.size() < m_capacity; }); // backpressure: block the reader
+	Job job;
+	job.request = request;
+	job.sink = sink;
+	m_queue.push_back(job);
+	m_notEmpty.notify_one();
+}
+
+void PlanningServer::waitUntilIdle()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_idle.wait(lock, [&]() { return m_queue.empty() && m_busy == 0; });
+}
+
+void PlanningServer::work()
+{
+	for (;;) {
+		Job job;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_notEmpty.wait(lock, [&]() { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty()) {
+				return; // stopping, and nothing left to do
+			}
+			job = m_queue.front();
+			m_queue.pop_front();
+			m_busy++;
+		}
+		m_notFull.notify_one();
+		string result;
+		string id = "null";
+		try {
+			result = plan(job.request, id);
+		}
+		catch (...) { // whatever a request does, the server keeps serving the others
+			result = errorLine(id, "BAD_REQUEST", "request could not be planned");
+		}
+		job.sink->writeLine(result);
+		job.sink.reset(); // a socket closes here once its last result is out
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_busy--;
+			if (m_queue.empty() && m_busy == 0) {
+				m_idle.notify_all();
+			}
+		}
+	}
+}
+
+string PlanningServer::plan(const string& request, string& id) const
+{
+	JsonValue root;
+	JsonReader reader(request);
+	if (!reader.parse(root) || root.type != JsonValue::OBJECT) {
+		return errorLine(id, "BAD_REQUEST", "request is not a JSON object");
+	}
+	id = jsonId(root.member("id"));
+	const JsonValue* command = root.member("command");
+	if (command != nullptr && command->scalar() == "stats") { // route cache counters instead of a plan
+		RouteCacheStats stats;
+		if (m_map->routeCache() != nullptr) {
+			stats = m_map->routeCache()->stats();
+		}
+		ostringstream out;
+		out << "{\"id\": " << id << ", \"status\": \"ok\", \"cache\": {\"enabled\": "
+		    << (m_map->routeCache() != nullptr ? "true" : "false") << ", \"hits\": " << stats.hits
+		    << ", \"misses\": " << stats.misses << ", \"evictions\": " << stats.evictions
+		    << ", \"routes\": " << stats.entries << ", \"edges\": " << stats.storedEdges << "}}";
+		return out.str();
+	}
+
+	GeoCoord depot;
+	if (!readCoord(root.member("depot"), depot)) {
+		return errorLine(id, "BAD_REQUEST", "depot must be [lat, lon] or {\"lat\": ..., \"lon\": ...} with numeric coordinates");
+	}
+	const JsonValue* stops = root.member("stops");
+	if (stops == nullptr || stops->type != JsonValue::ARRAY) {
+		return errorLine(id, "BAD_REQUEST", "stops must be an array");
+	}
+	vector<DeliveryRequest> deliveries;
+	for (const JsonValue& stop : stops->items) {
+		GeoCoord location;
+		const JsonValue* item = (stop.type == JsonValue::OBJECT) ? stop.member("item") : nullptr;
+		if (item == nullptr || item->scalar().empty() || !readCoord(&stop, location)) {
+			return errorLine(id, "BAD_REQUEST", "each stop needs an item and numeric lat and lon");
+		}
+		deliveries.push_back(DeliveryRequest(item->scalar(), location));
+	}
+	OptimizerOptions options;
+	options.numThreads = m_threadsPerPlan;
+	double maxSnapMiles = m_maxSnapMiles;
+	string message;
+	if (!readOptions(root.member("options"), options, maxSnapMiles, message)) {
+		return errorLine(id, "BAD_REQUEST", message);
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	DeliveryPlanner planner(m_map);
+	planner.setOptimizerOptions(options);
+	planner.setMaxSnapMiles(maxSnapMiles);
+	vector<DeliveryCommand> commands;
+	double miles;
+	DeliveryResult result = planner.generateDeliveryPlan(depot, deliveries, commands, miles);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (result == BAD_COORD) {
+		return errorLine(id, "BAD_COORD", "one or more depot or delivery coordinates are invalid");
+	}
+	if (result == NO_ROUTE) {
+		return errorLine(id, "NO_ROUTE", "no route can be found to deliver all items");
+	}
+
+	ostringstream out;
+	out.setf(ios::fixed);
+	out.precision(2);
+	out << "{\"id\": " << id << ", \"status\": \"ok\", \"miles\": " << miles;
+	out.precision(3);
+	out << ", \"seconds\": " << seconds << ", \"order\": [";
+	bool first = true;
+	for (const DeliveryCommand& c : commands) {
+		if (!c.item().empty()) {
+			out << (first ? "" : ", ") << jsonString(c.item());
+			first = false;
+		}
+	}
+	out << "], \"commands\": [";
+	for (size_t i = 0; i < commands.size(); i++) {
+		out << (i == 0 ? "" : ", ") << jsonString(commands[i].description());
+	}
+	out << "]}";
+	return out.str();
+}
+
+void PlanningServer::serveStream(istream& in, ostream& out)
+{
+	shared_ptr<ResultSink> sink(new StreamSink(out));
+	string line;
+	while (getline(in, line)) {
+		if (line.find_first_not_of(" \t\r") != string::npos) {
+			submit(line, sink);
+		}
+	}
+	waitUntilIdle();
+}
+
+bool PlanningServer::serveSocket(const string& path)
+{
+#if defined(_WIN32)
+	cerr << "Unix domain sockets are not supported on this platform" << endl;
+	return false;
+#else
+	signal(SIGPIPE, SIG_IGN); // a client hanging up must not kill the server
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		cerr << "Socket path too long: " << path << endl;
+		return false;
+	}
+	strcpy(address.sun_path, path.c_str());
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		cerr << "Unable to create socket: " << strerror(errno) << endl;
+		return false;
+	}
+	unlink(path.c_str()); // a socket file left by an earlier run
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+		cerr << "Unable to listen on " << path << ": " << strerror(errno) << endl;
+		close(listener);
+		return false;
+	}
+	for (;;) {
+		int client = accept(listener, nullptr, nullptr);
+		if (client < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			cerr << "Unable to accept connections: " << strerror(errno) << endl;
+			close(listener);
+			return false;
+		}
+		  // each client gets a reader thread; its jobs share the worker pool and the
+		  // connection closes when the client stops sending and its last result is out
+		shared_ptr<SocketSink> sink(new SocketSink(client));
+		thread([this, sink]() {
+			string pending;
+			char buffer[65536];
+			ssize_t n;
+			while ((n = read(sink->fd(), buffer, sizeof(buffer))) > 0) {
+				pending.append(buffer, (size_t)n);
+				size_t start = 0;
+				for (size_t end; (end = pending.find('\n', start)) != string::npos; start = end + 1) {
+					string line = pending.substr(start, end - start);
+					if (line.find_first_not_of(" \t\r") != string::npos) {
+						submit(line, sink);
+					}
+				}
+				pending.erase(0, start);
+			}
+			if (pending.find_first_not_of(" \t\r") != string::npos) {
+				submit(pending, sink);
+			}
+			shutdown(sink->fd(), SHUT_RD);
+		}).detach();
+	}
+#endif
+}
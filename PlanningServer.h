@@ -0,0 +1,97 @@
+#ifndef PLANNINGSERVER_INCLUDED
+#define PLANNINGSERVER_INCLUDED
+
+#include "provided.h"
+#include <string>
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// A long-running planner that keeps one loaded StreetMap warm and answers
+// planning requests sent as JSON lines, one request object per line:
+//
+//   {"id": 7, "depot": ["34.0625329", "-118.4470263"],
+//    "stops": [{"item": "Chicken tenders", "lat": "34.0712323", "lon": "-118.4505969"}, ...],
+//    "options": {"timeLimit": 0.5, "seed": 3}}
+//
+// Coordinates may be JSON strings or numbers; either way their text is used as
+// written. Points are matched to intersections by their numeric value, and one
+// that isn't an intersection is snapped to the nearest within maxSnapMiles, as
+// DeliveryPlanner does. "options" may set timeLimit, maxEvaluations, seed,
+// numChains, numThreads, maxSnapMiles and method ("anneal", "local" or
+// "anneal+local"); thread counts above the machine's core count are lowered to
+// it, and anything malformed is a BAD_REQUEST. Without numThreads a plan uses
+// its worker's share of the cores, one thread when there is a worker per core.
+// Each request gets one JSON line back, in the order the plans finish rather
+// than the order they arrived, carrying the request's id:
+//
+//   {"id": 7, "status": "ok", "miles": 1.78, "seconds": 0.004, "order": [...], "commands": [...]}
+//   {"id": 8, "status": "error", "error": "BAD_COORD", "message": "..."}
+//
+// {"id": 9, "command": "stats"} asks for the map's route cache counters instead.
+//
+// A fixed pool of worker threads plans requests from a bounded queue. When the
+// queue is full the reader stops reading until a worker frees a slot, so a client
+// sending faster than plans finish is slowed down rather than buffered without
+// limit.
+class PlanningServer
+{
+public:
+	  // numWorkers 0 means one per core; maxSnapMiles is each plan's snapping
+	  // radius unless the request sets its own (see DeliveryPlanner::setMaxSnapMiles)
+	PlanningServer(const StreetMap* sm, unsigned int numWorkers, unsigned int queueCapacity,
+	               double maxSnapMiles = DEFAULT_MAX_SNAP_MILES);
+	~PlanningServer();
+
+	  // serve requests read from in, writing results to out, until in ends and
+	  // every request read from it has been answered
+	void serveStream(std::istream& in, std::ostream& out);
+	  // listen on a Unix domain socket at path and serve each client that connects
+	  // the same way, all sharing the worker pool; only returns on failure
+	bool serveSocket(const std::string& path);
+
+	  // We prevent a PlanningServer object from being copied or assigned.
+	PlanningServer(const PlanningServer&) = delete;
+	PlanningServer& operator=(const PlanningServer&) = delete;
+
+	  // where one client's results go; lines may be written from any worker
+	class ResultSink
+	{
+	public:
+		virtual ~ResultSink() {}
+		virtual void writeLine(const std::string& line) = 0;
+	};
+
+private:
+	struct Job
+	{
+		std::string request;
+		std::shared_ptr<ResultSink> sink;
+	};
+
+	void submit(const std::string& request, const std::shared_ptr<ResultSink>& sink);
+	void waitUntilIdle();
+	void work();
+	  // the result line for request; sets id to the request's id (as JSON) once
+	  // it is known, so an error thrown later can still carry it
+	std::string plan(const std::string& request, std::string& id) const;
+
+	const StreetMap* m_map;
+	unsigned int m_capacity;
+	double m_maxSnapMiles;
+	unsigned int m_threadsPerPlan; // each worker's share of the cores, unless a request asks for more
+	std::deque<Job> m_queue;
+	unsigned int m_busy;     // jobs taken off the queue and not yet answered
+	bool m_stopping;
+	std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+	std::condition_variable m_notFull;
+	std::condition_variable m_idle;
+	std::vector<std::thread> m_workers;
+};
+
+#endif // PLANNINGSERVER_INCLUDED
@@ -1,10 +1,13 @@
 #include "provided.h"
-#include "ExpandableHashMap.h"
+#include "StreetGraph.h"
+#include "SearchWorkspace.h"
+#include "ContractionHierarchy.h"
+#include "LandmarkTable.h"
+#include "RouteCache.h"
 #include <list>
-#include <queue>
-#include <map>
-#include <set>
-#include <stack>
+#include <vector>
+#include <algorithm>
+#include <limits>
 using namespace std;
 
 class PointToPointRouterImpl
@@ -16,19 +19,33 @@ public:
         const GeoCoord& start,
         const GeoCoord& end,
         list<StreetSegment>& route,
-        double& totalDistanceTravelled) const;
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace,
+        RouteAlgorithm algorithm) const;
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteAlgorithm algorithm) const;
 private:
-	StreetMap* streetMap;
-	typedef pair<double, GeoCoord> Pair;
-	struct cmpStruct {
-		bool operator()(const pair<double, GeoCoord>& lhs, const pair<double, GeoCoord>& rhs) const {
-			return lhs.first < rhs.first;
-		}
-	};
+	  // A* from one node to another; fills path with the edges taken, in order.
+	  // landmarks, if not null, tighten the straight-line heuristic.
+	bool findPath(unsigned int startNode, unsigned int endNode, vector<const StreetEdge*>& path, SearchWorkspace& ws,
+	              const LandmarkTable* landmarks) const;
+	  // the same, searching from both ends at once
+	bool findPathBidirectional(unsigned int startNode, unsigned int endNode, vector<const StreetEdge*>& path, SearchWorkspace& ws) const;
+	DeliveryResult emitRoute(const StreetGraph& graph, const vector<const StreetEdge*>& path,
+	                         list<StreetSegment>& route, double& totalDistanceTravelled) const;
+	static bool pathOf(const StreetGraph& graph, unsigned int startNode, unsigned int endNode,
+	                   const vector<unsigned int>& edges, vector<const StreetEdge*>& path);
+
+	const StreetMap* streetMap;
+	mutable WorkspacePool workspaces; // one per concurrent query, reused across queries
 };
 
 PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm) {
-	streetMap = const_cast<StreetMap*>(sm);
+	streetMap = sm;
 }
 
 PointToPointRouterImpl::~PointToPointRouterImpl() {
@@ -39,84 +56,230 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
         list<StreetSegment>& route,
-        double& totalDistanceTravelled) const {
-	map<GeoCoord, pair<GeoCoord, string>> moveMap;
-	ExpandableHashMap<GeoCoord, double> fMap;
-	ExpandableHashMap<GeoCoord, double> gMap;
-	set <pair<double, GeoCoord>, cmpStruct> openList;
-	set <GeoCoord> closedList;
-	vector<StreetSegment> segs;
+        double& totalDistanceTravelled,
+        RouteAlgorithm algorithm) const {
+	WorkspacePool::Lease ws(workspaces);
+	return generatePointToPointRoute(start, end, route, totalDistanceTravelled, *ws, algorithm);
+}
+
+DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace,
+        RouteAlgorithm algorithm) const {
+	const StreetGraph& graph = (*streetMap).graph();
 	// if the start or end doesn't exist in the map, return
-	if (!(*streetMap).getSegmentsThatStartWith(end, segs) || !(*streetMap).getSegmentsThatStartWith(start, segs)) {
+	unsigned int startNode = graph.findNode(start);
+	unsigned int endNode = graph.findNode(end);
+	if (startNode == StreetGraph::NO_NODE || endNode == StreetGraph::NO_NODE) {
 		return BAD_COORD;
 	}
-	openList.insert(make_pair(0.0, start)); // insert first coord into open list
-	// record the first coord's values
-	fMap.associate(start, 0);
-	gMap.associate(start, 0);
 
+	vector<const StreetEdge*> path;
+	RouteCache* cache = (*streetMap).routeCache();
+	vector<unsigned int> cachedEdges;
+	double cachedLength;
+	if (cache != nullptr && cache->find(startNode, endNode, cachedEdges, cachedLength) &&
+	    pathOf(graph, startNode, endNode, cachedEdges, path)) {
+		return emitRoute(graph, path, route, totalDistanceTravelled);
+	}
+
+	const ContractionHierarchy& hierarchy = (*streetMap).contractionHierarchy();
+	const LandmarkTable& landmarks = (*streetMap).landmarks();
+	if (algorithm == ROUTE_CONTRACTION_HIERARCHY && hierarchy.empty()) { // use the best the map was prepared for
+		algorithm = ROUTE_ALT;
+	}
+	if (algorithm == ROUTE_ALT && landmarks.empty()) {
+		algorithm = ROUTE_ASTAR;
+	}
+	bool found;
+	switch (algorithm) {
+	case ROUTE_BIDIRECTIONAL_ASTAR:
+		found = findPathBidirectional(startNode, endNode, path, workspace);
+		break;
+	case ROUTE_CONTRACTION_HIERARCHY:
+		found = hierarchy.findPath(startNode, endNode, path, workspace);
+		break;
+	case ROUTE_ALT:
+		found = findPath(startNode, endNode, path, workspace, &landmarks);
+		break;
+	default:
+		found = findPath(startNode, endNode, path, workspace, nullptr);
+		break;
+	}
+	if (!found) {
+		return NO_ROUTE;
+	}
+	if (cache != nullptr) {
+		cachedEdges.clear();
+		cachedLength = 0;
+		for (const StreetEdge* e : path) {
+			cachedEdges.push_back(graph.edgeIndex(*e));
+			cachedLength += e->length;
+		}
+		cache->insert(startNode, endNode, cachedEdges, cachedLength);
+	}
+	return emitRoute(graph, path, route, totalDistanceTravelled);
+}
+
+  // turn a path into the caller's route, adding up its length
+DeliveryResult PointToPointRouterImpl::emitRoute(const StreetGraph& graph, const vector<const StreetEdge*>& path,
+                                                 list<StreetSegment>& route, double& totalDistanceTravelled) const {
+	route.clear();
+	for (const StreetEdge* e : path) { // only the final route is turned into StreetSegments
+		totalDistanceTravelled += e->length;
+		route.push_back(graph.segment(*e));
+	}
+	return DELIVERY_SUCCESS;
+}
+
+  // The edges of a cached route, which are exactly the ones the search chose.
+  // False if they don't lead from startNode to endNode, which would mean the
+  // cache is stale.
+bool PointToPointRouterImpl::pathOf(const StreetGraph& graph, unsigned int startNode, unsigned int endNode,
+                                    const vector<unsigned int>& edges, vector<const StreetEdge*>& path) {
+	path.clear();
+	unsigned int at = startNode;
+	for (unsigned int i : edges) {
+		if (i >= graph.numEdges() || graph.edge(i).from != at) {
+			return false;
+		}
+		path.push_back(&graph.edge(i));
+		at = graph.edge(i).to;
+	}
+	return at == endNode;
+}
+
+  // A* heuristic: straight-line distance to the end, or the landmark bound when
+  // that is larger. Both are consistent (the landmark one up to float rounding,
+  // far below a foot), and so is their maximum.
+struct RemainingDistance
+{
+	const StreetGraph& graph;
+	const LandmarkTable* landmarks;
+	unsigned int endNode;
+
+	double operator()(unsigned int node) const
+	{
+		double h = graph.distanceMiles(node, endNode);
+		if (landmarks != nullptr) {
+			h = max(h, landmarks->lowerBound(node, endNode));
+		}
+		return h;
+	}
+};
+
+bool PointToPointRouterImpl::findPath(unsigned int startNode, unsigned int endNode, vector<const StreetEdge*>& path, SearchWorkspace& ws,
+                                      const LandmarkTable* landmarks) const {
+	const StreetGraph& graph = (*streetMap).graph();
+	RemainingDistance h = { graph, landmarks, endNode };
+	path.clear();
+	if (startNode == endNode) { // already there
+		return true;
+	}
+
+	// the workspace holds g, the parent edge and the settled flag per node; a new
+	// generation makes every label read as untouched without clearing the arrays
+	ws.reset(graph.numNodes());
+	IndexedHeap<4>& openList = ws.openList(); // keyed by f = g + h
+
+	ws.label(startNode, 0, nullptr);
+	openList.push(startNode, h(startNode));
 	while (!openList.empty()) {
-		auto it = openList.begin();
-		GeoCoord q = (*it).second; // get the first item in the open list (smallest f value)
-		openList.erase(it);
-		closedList.insert(q);
-
-		double gNew, hNew, fNew;
-		(*streetMap).getSegmentsThatStartWith(q, segs);
-		for (unsigned int i = 0; i < segs.size(); ++i) { // go through all children of q
-			GeoCoord succ = segs[i].end;
-			string streetName = segs[i].name;
-			if (succ.latitude == end.latitude && succ.longitude == end.longitude) { // arrived at destination
-				moveMap.insert(make_pair(succ, make_pair(segs[i].start, segs[i].name)));
-				route.clear();
-				GeoCoord currCoord = end;
-				// retrace path into route
-				while (!(currCoord.latitude == start.latitude && currCoord.longitude == start.longitude)) {
-					GeoCoord prev = moveMap.at(currCoord).first;
-					string name = moveMap.at(currCoord).second;
-					totalDistanceTravelled += distanceEarthMiles(prev, currCoord);
-					StreetSegment s(prev, currCoord, name);
-					route.push_front(s);
-					currCoord = prev;
-				}
-				return DELIVERY_SUCCESS;
+		unsigned int q = openList.pop(); // smallest f value
+		if (q == endNode) { // the heuristic is consistent, so the first time the end is popped its g is optimal
+			for (unsigned int curr = endNode; curr != startNode; curr = ws.parent(curr)->from) {
+				path.push_back(ws.parent(curr));
 			}
+			reverse(path.begin(), path.end());
+			return true;
+		}
+		ws.close(q);
+
+		double gq = ws.g(q);
+		for (const StreetEdge& e : graph.edgesFrom(q)) { // go through all children of q
+			unsigned int succ = e.to;
+			if (ws.closed(succ)) {
+				continue;
+			}
+			double gNew = gq + e.length;
+			if (gNew < ws.g(succ)) { // better way to reach succ: record it and requeue (or decrease-key) it
+				ws.label(succ, gNew, &e);
+				openList.pushOrDecrease(succ, gNew + h(succ));
+			}
+		}
+	}
+	return false; // open list ran dry without reaching the end
+}
 
-			if (closedList.find(succ) == closedList.end()) { // check if in closed list
-				// calculate values
-				double* fOld = fMap.find(succ);
+bool PointToPointRouterImpl::findPathBidirectional(unsigned int startNode, unsigned int endNode, vector<const StreetEdge*>& path, SearchWorkspace& ws) const {
+	const StreetGraph& graph = (*streetMap).graph();
+	path.clear();
+	if (startNode == endNode) {
+		return true;
+	}
 
-				double* oldG = gMap.find(q);
+	// Average potential: pf(v) = (dist(v, end) - dist(start, v)) / 2 for the forward
+	// search and -pf(v) for the backward one. Both are consistent, so each side is
+	// a Dijkstra on non-negative reduced costs, and once the two smallest keys sum
+	// to at least the best path through a meeting node, that path is shortest.
+	SearchWorkspace* side[2] = { &ws, &ws.reverse() };
+	unsigned int origin[2] = { startNode, endNode };
+	double sign[2] = { 1, -1 };
+	for (int d = 0; d < 2; d++) {
+		side[d]->reset(graph.numNodes());
+		side[d]->label(origin[d], 0, nullptr);
+		double p = (graph.distanceMiles(origin[d], endNode) - graph.distanceMiles(startNode, origin[d])) / 2;
+		side[d]->openList().push(origin[d], sign[d] * p);
+	}
 
-				if (oldG != nullptr) {
-					gNew = *oldG + distanceEarthMiles(q, succ);
-				}
-				else {
-					gNew = distanceEarthMiles(q, succ);
-				}
-				hNew = distanceEarthMiles(end, succ);;
-				fNew = gNew + hNew;
-
-				bool skip = false;
-				auto it = openList.begin(); // check if in open list
-				while (it != openList.end()) {
-					if (succ == (*it).second && fOld != nullptr && *fOld < fNew) {
-						skip = true;
-						break;
-					}
-					it++;
-				}
+	double best = numeric_limits<double>::infinity(); // shortest start -> end path seen so far
+	unsigned int meet = StreetGraph::NO_NODE;
+	while (!side[0]->openList().empty() && !side[1]->openList().empty()) {
+		if (side[0]->openList().topKey() + side[1]->openList().topKey() >= best) {
+			break;
+		}
+		int d = (side[0]->openList().topKey() <= side[1]->openList().topKey()) ? 0 : 1; // grow the smaller frontier
+		SearchWorkspace& here = *side[d];
+		SearchWorkspace& there = *side[1 - d];
+		unsigned int q = here.openList().pop();
+		here.close(q);
 
-				if (!skip) { // if the new coord is better/doesn't yet exist, insert it and its assocations into the list
-					openList.insert(make_pair(fNew, succ));
-					moveMap.insert(make_pair(succ, make_pair(segs[i].start, segs[i].name)));
-					fMap.associate(succ, fNew);
-					gMap.associate(succ, gNew);
+		double gq = here.g(q);
+		for (const StreetEdge& e : graph.edgesFrom(q)) { // the graph is symmetric, so this serves both directions
+			unsigned int succ = e.to;
+			if (here.closed(succ)) {
+				continue;
+			}
+			double gNew = gq + e.length;
+			if (gNew < here.g(succ)) {
+				here.label(succ, gNew, &e);
+				double p = (graph.distanceMiles(succ, endNode) - graph.distanceMiles(startNode, succ)) / 2;
+				here.openList().pushOrDecrease(succ, gNew + sign[d] * p);
+				if (gNew + there.g(succ) < best) { // the two searches touch at succ
+					best = gNew + there.g(succ);
+					meet = succ;
 				}
 			}
 		}
 	}
-	return NO_ROUTE;
+	if (meet == StreetGraph::NO_NODE) {
+		return false;
+	}
+
+	// start -> meet from the forward labels, then meet -> end by flipping the
+	// backward search's edges (each one points away from the end; every edge has
+	// a reverse, which StreetGraph::validate checks for snapshots)
+	for (unsigned int curr = meet; curr != startNode; curr = side[0]->parent(curr)->from) {
+		path.push_back(side[0]->parent(curr));
+	}
+	reverse(path.begin(), path.end());
+	for (unsigned int curr = meet; curr != endNode; curr = side[1]->parent(curr)->from) {
+		path.push_back(graph.reverseOf(*side[1]->parent(curr)));
+	}
+	return true;
 }
 
 //******************** PointToPointRouter functions ***************************
@@ -140,5 +303,26 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const
 {
-    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, ROUTE_CONTRACTION_HIERARCHY);
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace,
+        RouteAlgorithm algorithm) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, workspace, algorithm);
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteAlgorithm algorithm) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, algorithm);
 }
@@ -0,0 +1,130 @@
+#include "RouteCache.h"
+#include <utility>
+using namespace std;
+
+RouteCache::RouteCache(unsigned long long maxRoutes)
+ : m_maxRoutes(maxRoutes), m_shards(new Shard[NUM_SHARDS]), m_hits(0), m_misses(0), m_evictions(0)
+{
+	for (unsigned int i = 0; i < NUM_SHARDS; i++) { // shares that add up to maxRoutes
+		m_shards[i].capacity = maxRoutes / NUM_SHARDS + (i < maxRoutes % NUM_SHARDS ? 1 : 0);
+	}
+}
+
+const RouteCache::Route* RouteCache::touch(Shard& shard, unsigned long long key)
+{
+	auto it = shard.index.find(key);
+	if (it == shard.index.end()) {
+		m_misses++;
+		return nullptr;
+	}
+	m_hits++;
+	shard.routes.splice(shard.routes.begin(), shard.routes, it->second); // iterators stay valid
+	return &*it->second;
+}
+
+bool RouteCache::find(unsigned int start, unsigned int end, vector<unsigned int>& edges, double& length)
+{
+	unsigned long long key = keyOf(start, end);
+	Shard& shard = shardOf(key);
+	lock_guard<mutex> lock(shard.mutex);
+	const Route* route = touch(shard, key);
+	if (route == nullptr) {
+		return false;
+	}
+	edges = route->edges;
+	length = route->length;
+	return true;
+}
+
+bool RouteCache::findLengths(unsigned int start, const vector<unsigned int>& ends, double* lengths)
+{
+	unsigned long long asked = 0;
+	bool all = true;
+	for (unsigned int j = 0; j < ends.size(); j++) { // look without using anything
+		if (ends[j] == start) {
+			lengths[j] = 0;
+			continue;
+		}
+		asked++;
+		unsigned long long key = keyOf(start, ends[j]);
+		Shard& shard = shardOf(key);
+		lock_guard<mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+		if (it == shard.index.end()) {
+			all = false;
+		}
+		else {
+			lengths[j] = it->second->length;
+		}
+	}
+	if (!all) {
+		m_misses += asked;
+		return false;
+	}
+	for (unsigned int j = 0; j < ends.size(); j++) { // every route was served: mark them used
+		if (ends[j] != start) {
+			unsigned long long key = keyOf(start, ends[j]);
+			Shard& shard = shardOf(key);
+			lock_guard<mutex> lock(shard.mutex);
+			auto it = shard.index.find(key);
+			if (it != shard.index.end()) { // another thread may have evicted it meanwhile
+				shard.routes.splice(shard.routes.begin(), shard.routes, it->second);
+			}
+		}
+	}
+	m_hits += asked;
+	return true;
+}
+
+void RouteCache::insert(unsigned int start, unsigned int end, const vector<unsigned int>& edges, double length)
+{
+	unsigned long long key = keyOf(start, end);
+	Shard& shard = shardOf(key);
+	if (shard.capacity == 0) {
+		return;
+	}
+	lock_guard<mutex> lock(shard.mutex);
+	if (shard.index.find(key) != shard.index.end()) {
+		return; // another thread found it first; it's the same length either way
+	}
+	while (shard.routes.size() >= shard.capacity) {
+		const Route& oldest = shard.routes.back();
+		shard.storedEdges -= oldest.edges.size();
+		shard.index.erase(oldest.key);
+		shard.routes.pop_back();
+		m_evictions++;
+	}
+	Route route;
+	route.key = key;
+	route.length = length;
+	route.edges = edges;
+	shard.storedEdges += edges.size();
+	shard.routes.push_front(move(route));
+	shard.index[key] = shard.routes.begin();
+}
+
+RouteCacheStats RouteCache::stats() const
+{
+	RouteCacheStats s;
+	s.hits = m_hits;
+	s.misses = m_misses;
+	s.evictions = m_evictions;
+	for (unsigned int i = 0; i < NUM_SHARDS; i++) {
+		Shard& shard = m_shards[i];
+		lock_guard<mutex> lock(shard.mutex);
+		s.entries += shard.routes.size();
+		s.storedEdges += shard.storedEdges;
+	}
+	return s;
+}
+
+void RouteCache::clear()
+{
+	for (unsigned int i = 0; i < NUM_SHARDS; i++) {
+		Shard& shard = m_shards[i];
+		lock_guard<mutex> lock(shard.mutex);
+		shard.routes.clear();
+		shard.index.clear();
+		shard.storedEdges = 0;
+	}
+}
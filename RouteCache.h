@@ -0,0 +1,94 @@
+#ifndef ROUTECACHE_INCLUDED
+#define ROUTECACHE_INCLUDED
+
+#include "HashPolicy.h"
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+struct RouteCacheStats
+{
+	RouteCacheStats()
+	 : hits(0), misses(0), evictions(0), entries(0), storedEdges(0)
+	{}
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	unsigned long long entries;     // routes held now
+	unsigned long long storedEdges; // edge ids held now, over all routes
+};
+
+// Shortest routes between pairs of graph nodes, kept across planning requests
+// so recurring legs (the depot, dorms, office buildings) aren't searched for
+// again. A route is stored as the ids of its edges (indexes into the graph's edge
+// array) plus its length, 4 bytes an edge, so a cached route comes back over the
+// very streets the search chose, even where two streets join the same pair of
+// intersections. At most maxRoutes routes are kept.
+//
+// Safe to use from many threads: the routes are split into shards by key, each
+// with its own lock and recency list, so threads rarely wait on each other. Each
+// shard holds an even share of maxRoutes, and when a shard is full its own least
+// recently used route makes room, which need not be the oldest route overall.
+// With fewer than 16 routes allowed, some shards get no share and the routes
+// that fall in them aren't cached.
+class RouteCache
+{
+public:
+	RouteCache(unsigned long long maxRoutes);
+
+	  // the route from start to end, if cached: its edge ids, in order, and length
+	bool find(unsigned int start, unsigned int end, std::vector<unsigned int>& edges, double& length);
+	  // The lengths from start to each of ends (0 where an end is start) if every
+	  // one of those routes is cached, for callers that only need distances. A
+	  // lookup that comes up short records no hits and uses no routes; it counts a
+	  // miss for each route asked for, since the caller searches for them all.
+	bool findLengths(unsigned int start, const std::vector<unsigned int>& ends, double* lengths);
+	  // remember a route; edges runs from start to end
+	void insert(unsigned int start, unsigned int end, const std::vector<unsigned int>& edges, double length);
+
+	unsigned long long capacity() const { return m_maxRoutes; }
+	RouteCacheStats stats() const;
+	void clear();
+
+	  // We prevent a RouteCache object from being copied or assigned.
+	RouteCache(const RouteCache&) = delete;
+	RouteCache& operator=(const RouteCache&) = delete;
+
+private:
+	static const unsigned int NUM_SHARDS = 16;
+
+	struct Route
+	{
+		unsigned long long key;
+		double length;
+		std::vector<unsigned int> edges;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::list<Route> routes; // most recently used first
+		std::unordered_map<unsigned long long, std::list<Route>::iterator, DefaultHash<unsigned long long> > index;
+		unsigned long long storedEdges = 0;
+		unsigned long long capacity = 0; // this shard's share of maxRoutes
+	};
+
+	static unsigned long long keyOf(unsigned int start, unsigned int end)
+	{
+		return ((unsigned long long)start << 32) | end;
+	}
+	Shard& shardOf(unsigned long long key) { return m_shards[fibonacciHash(key) % NUM_SHARDS]; }
+	  // the shard's route for key, moved to the front, or nullptr; shard must be locked
+	const Route* touch(Shard& shard, unsigned long long key);
+
+	unsigned long long m_maxRoutes;
+	std::unique_ptr<Shard[]> m_shards;
+	std::atomic<unsigned long long> m_hits;
+	std::atomic<unsigned long long> m_misses;
+	std::atomic<unsigned long long> m_evictions;
+};
+
+#endif // ROUTECACHE_INCLUDED
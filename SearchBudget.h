@@ -0,0 +1,81 @@
+#ifndef SEARCHBUDGET_INCLUDED
+#define SEARCHBUDGET_INCLUDED
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+
+// How much work an anytime search may still do: a wall-clock deadline and/or a
+// number of evaluations (scoring one candidate change to a tour), either of
+// which may be unlimited. Searches charge their evaluations in batches and stop,
+// keeping the best tour they have, once charge() says the budget is spent.
+//
+// A budget can be split: a child gets its own share of the evaluations and
+// passes every charge up to its parent, so the root keeps the totals and its
+// deadline stops every child. Giving each parallel chain a fixed share, the
+// shares adding up to no more than the parent's limit, keeps the result the same
+// however the chains are scheduled (deadlines aside).
+class SearchBudget
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	  // seconds <= 0 and evaluations == 0 mean no limit
+	SearchBudget(double seconds, unsigned long long evaluations)
+	 : m_parent(nullptr), m_start(Clock::now()), m_hasDeadline(seconds > 0), m_limit(evaluations),
+	   m_used(0), m_exhausted(false)
+	{
+		if (m_hasDeadline) {
+			m_deadline = m_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+		}
+	}
+
+	  // a share of parent's budget; evaluations == 0 means only the parent's limits apply
+	SearchBudget(SearchBudget& parent, unsigned long long evaluations)
+	 : m_parent(&parent), m_start(parent.m_start), m_hasDeadline(false), m_limit(evaluations),
+	   m_used(0), m_exhausted(false)
+	{}
+
+	  // record evaluations done; true once the budget is spent. A budget with a
+	  // limit counts, and passes up, no more than it has left, so children whose
+	  // shares add up to their parent's limit never run the parent out early.
+	bool charge(unsigned long long evaluations)
+	{
+		unsigned long long used = m_used;
+		unsigned long long counted;
+		do {
+			counted = (m_limit == 0) ? evaluations : std::min(evaluations, m_limit - used);
+		} while (!m_used.compare_exchange_weak(used, used + counted));
+		used += counted;
+		bool parentDone = (m_parent != nullptr) && m_parent->charge(counted);
+		if (parentDone || (m_limit != 0 && used >= m_limit) || (m_hasDeadline && Clock::now() >= m_deadline)) {
+			m_exhausted = true;
+		}
+		return m_exhausted;
+	}
+
+	bool exhausted() const { return m_exhausted || (m_parent != nullptr && m_parent->exhausted()); }
+	unsigned long long used() const { return m_used; }
+	  // this budget's own evaluation limit, or 0 if it has none
+	unsigned long long limit() const { return m_limit; }
+	double elapsedSeconds() const { return std::chrono::duration<double>(Clock::now() - m_start).count(); }
+
+	  // We prevent a SearchBudget object from being copied or assigned.
+	SearchBudget(const SearchBudget&) = delete;
+	SearchBudget& operator=(const SearchBudget&) = delete;
+
+private:
+	SearchBudget* m_parent;
+	Clock::time_point m_start;
+	Clock::time_point m_deadline;
+	bool m_hasDeadline;
+	unsigned long long m_limit;
+	std::atomic<unsigned long long> m_used;
+	std::atomic<bool> m_exhausted;
+};
+
+// how many evaluations a search does between charges, so the shared counters
+// and the clock are touched rarely
+const unsigned int BUDGET_BATCH = 256;
+
+#endif // SEARCHBUDGET_INCLUDED
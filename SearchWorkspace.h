@@ -0,0 +1,149 @@
+#ifndef SEARCHWORKSPACE_INCLUDED
+#define SEARCHWORKSPACE_INCLUDED
+
+#include "IndexedHeap.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <limits>
+
+struct StreetEdge;
+
+// Scratch state for one graph search: a label (g value, parent edge, settled
+// flag) per node plus the open list. The arrays are sized once per graph and
+// reused; each search starts a new generation, and a label whose stamp isn't the
+// current generation reads as untouched, so clearing costs O(1) instead of
+// O(numNodes). A workspace serves one search at a time; give each thread its own.
+class SearchWorkspace
+{
+public:
+	SearchWorkspace()
+	 : m_generation(0)
+	{}
+
+	  // get ready for a new search over a graph with numNodes nodes
+	void reset(unsigned int numNodes)
+	{
+		if (m_labels.size() != numNodes) {
+			m_labels.assign(numNodes, Label());
+			m_openList.resize(numNodes);
+			m_generation = 0;
+		}
+		else {
+			m_openList.clear(); // only touches nodes left queued by the last search
+		}
+		if (++m_generation == 0) { // stamps wrapped around: wipe them once and start over
+			for (Label& l : m_labels) {
+				l.stamp = 0;
+			}
+			m_generation = 1;
+		}
+	}
+
+	bool seen(unsigned int node) const { return m_labels[node].stamp == m_generation; }
+	bool closed(unsigned int node) const { return seen(node) && m_labels[node].closed; }
+	double g(unsigned int node) const
+	{
+		return seen(node) ? m_labels[node].g : std::numeric_limits<double>::infinity();
+	}
+	const StreetEdge* parent(unsigned int node) const { return seen(node) ? m_labels[node].parent : nullptr; }
+
+	  // record the best known way to reach node so far
+	void label(unsigned int node, double g, const StreetEdge* parent)
+	{
+		Label& l = m_labels[node];
+		if (l.stamp != m_generation) {
+			l.stamp = m_generation;
+			l.closed = false;
+		}
+		l.g = g;
+		l.parent = parent;
+	}
+
+	void close(unsigned int node) { m_labels[node].closed = true; } // node must be labelled
+
+	IndexedHeap<4>& openList() { return m_openList; }
+
+	  // a second workspace for searches that also run backwards from the target;
+	  // created the first time one is needed and kept with this one after that
+	SearchWorkspace& reverse()
+	{
+		if (!m_reverse) {
+			m_reverse.reset(new SearchWorkspace);
+		}
+		return *m_reverse;
+	}
+
+	  // We prevent a SearchWorkspace object from being copied or assigned.
+	SearchWorkspace(const SearchWorkspace&) = delete;
+	SearchWorkspace& operator=(const SearchWorkspace&) = delete;
+
+private:
+	struct Label {
+		Label() : stamp(0), closed(false), g(0), parent(nullptr) {}
+		unsigned int stamp;
+		bool closed;
+		double g;
+		const StreetEdge* parent;
+	};
+
+	std::vector<Label> m_labels;
+	IndexedHeap<4> m_openList;
+	unsigned int m_generation;
+	std::unique_ptr<SearchWorkspace> m_reverse;
+};
+
+// A thread-safe stash of workspaces, so an object that is queried from many
+// threads hands each concurrent query its own workspace without allocating one
+// per call. Use it through WorkspacePool::Lease.
+class WorkspacePool
+{
+public:
+	WorkspacePool() {}
+
+	  // borrows a workspace for as long as the lease is alive
+	class Lease
+	{
+	public:
+		explicit Lease(WorkspacePool& pool)
+		 : m_pool(pool), m_ws(pool.acquire())
+		{}
+		~Lease() { m_pool.release(m_ws); }
+		SearchWorkspace& operator*() const { return *m_ws; }
+		SearchWorkspace* operator->() const { return m_ws; }
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+	private:
+		WorkspacePool& m_pool;
+		SearchWorkspace* m_ws;
+	};
+
+	  // We prevent a WorkspacePool object from being copied or assigned.
+	WorkspacePool(const WorkspacePool&) = delete;
+	WorkspacePool& operator=(const WorkspacePool&) = delete;
+
+private:
+	SearchWorkspace* acquire()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_idle.empty()) {
+			m_all.push_back(std::unique_ptr<SearchWorkspace>(new SearchWorkspace));
+			return m_all.back().get();
+		}
+		SearchWorkspace* ws = m_idle.back();
+		m_idle.pop_back();
+		return ws;
+	}
+
+	void release(SearchWorkspace* ws)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_idle.push_back(ws);
+	}
+
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<SearchWorkspace> > m_all;
+	std::vector<SearchWorkspace*> m_idle;
+};
+
+#endif // SEARCHWORKSPACE_INCLUDED
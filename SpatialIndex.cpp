@@ -0,0 +1,270 @@
+#include "SpatialIndex.h"
+#include "StreetGraph.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+using namespace std;
+
+// a query this many cells or more off the grid is treated as this far, which
+// keeps cell arithmetic in int range without changing which point is nearest
+static const double MAX_CELL_OFFSET = 1e8;
+
+SpatialIndex::SpatialIndex()
+ : m_graph(nullptr), m_milesPerLatDegree(0), m_milesPerLonDegree(0), m_minX(0), m_minY(0),
+   m_cellSize(1), m_columns(0), m_rows(0)
+{}
+
+void SpatialIndex::clear()
+{
+	m_graph = nullptr;
+	m_columns = m_rows = 0;
+	m_nodeStart.clear();
+	m_nodes.clear();
+	m_edgeStart.clear();
+	m_edges.clear();
+}
+
+int SpatialIndex::column(double px) const
+{
+	double c = floor((px - m_minX) / m_cellSize);
+	return (int)max(-MAX_CELL_OFFSET, min(c, MAX_CELL_OFFSET));
+}
+
+int SpatialIndex::row(double py) const
+{
+	double r = floor((py - m_minY) / m_cellSize);
+	return (int)max(-MAX_CELL_OFFSET, min(r, MAX_CELL_OFFSET));
+}
+
+void SpatialIndex::build(const StreetGraph& g)
+{
+	clear();
+	unsigned int n = g.numNodes();
+	if (n == 0) {
+		return;
+	}
+	m_graph = &g;
+
+	double minLat = g.latitude(0), maxLat = minLat, minLon = g.longitude(0), maxLon = minLon;
+	for (unsigned int v = 1; v < n; v++) {
+		minLat = min(minLat, g.latitude(v));
+		maxLat = max(maxLat, g.latitude(v));
+		minLon = min(minLon, g.longitude(v));
+		maxLon = max(maxLon, g.longitude(v));
+	}
+	const double earthRadiusMiles = 6371.0 / 1.609344; // as distanceEarthMiles has it
+	m_milesPerLatDegree = deg2rad(1) * earthRadiusMiles;
+	m_milesPerLonDegree = m_milesPerLatDegree * cos(deg2rad((minLat + maxLat) / 2));
+	m_minX = x(minLon);
+	m_minY = y(minLat);
+	double width = x(maxLon) - m_minX;
+	double height = y(maxLat) - m_minY;
+	double targetCells = max(1.0, n / 2.0);
+	m_cellSize = sqrt(max(width * height, 1e-12) / targetCells);
+	m_cellSize = max(m_cellSize, max(width, height) / targetCells); // a map that is all one line
+	m_cellSize = max(m_cellSize, 1e-6);
+	m_columns = (int)(width / m_cellSize) + 1;
+	m_rows = (int)(height / m_cellSize) + 1;
+	size_t numCells = (size_t)m_columns * m_rows;
+
+	// nodes: count per cell, then place (a counting sort, so each cell is one run)
+	vector<unsigned int> cellOf(n);
+	m_nodeStart.assign(numCells + 1, 0);
+	for (unsigned int v = 0; v < n; v++) {
+		cellOf[v] = (unsigned int)(row(y(g.latitude(v))) * m_columns + column(x(g.longitude(v))));
+		m_nodeStart[cellOf[v] + 1]++;
+	}
+	for (size_t i = 0; i < numCells; i++) {
+		m_nodeStart[i + 1] += m_nodeStart[i];
+	}
+	m_nodes.resize(n);
+	vector<unsigned int> fill(m_nodeStart.begin(), m_nodeStart.end() - 1);
+	for (unsigned int v = 0; v < n; v++) {
+		m_nodes[fill[cellOf[v]]++] = v;
+	}
+
+	// segments: one direction of each, under every cell of its bounding box
+	vector<pair<unsigned int, unsigned int> > filed; // (cell, edge)
+	for (unsigned int i = 0; i < g.numEdges(); i++) {
+		const StreetEdge& e = g.edge(i);
+		const StreetEdge* r = g.reverseOf(e);
+		if (r != nullptr && g.edgeIndex(*r) < i) {
+			continue; // the other direction is filed already
+		}
+		int c0 = column(x(g.longitude(e.from))), c1 = column(x(g.longitude(e.to)));
+		int r0 = row(y(g.latitude(e.from))), r1 = row(y(g.latitude(e.to)));
+		for (int rr = min(r0, r1); rr <= max(r0, r1); rr++) {
+			for (int cc = min(c0, c1); cc <= max(c0, c1); cc++) {
+				filed.push_back(make_pair((unsigned int)(rr * m_columns + cc), i));
+			}
+		}
+	}
+	sort(filed.begin(), filed.end());
+	m_edgeStart.assign(numCells + 1, 0);
+	m_edges.resize(filed.size());
+	for (size_t k = 0; k < filed.size(); k++) {
+		m_edgeStart[filed[k].first + 1]++;
+		m_edges[k] = filed[k].second;
+	}
+	for (size_t i = 0; i < numCells; i++) {
+		m_edgeStart[i + 1] += m_edgeStart[i];
+	}
+}
+
+int SpatialIndex::firstRing(int c, int r) const
+{
+	return max(max(0, max(-c, c - (m_columns - 1))), max(-r, r - (m_rows - 1)));
+}
+
+template<class Visit>
+bool SpatialIndex::visitRing(int c, int r, int ring, Visit visit) const
+{
+	int inner = ring - 1;
+	if (ring > 0 && c - inner <= 0 && r - inner <= 0 && c + inner >= m_columns - 1 && r + inner >= m_rows - 1) {
+		return false; // the rings so far already cover the whole grid
+	}
+	int cLo = max(c - ring, 0), cHi = min(c + ring, m_columns - 1);
+	int rLo = max(r - ring, 0), rHi = min(r + ring, m_rows - 1);
+	if (cLo > cHi || rLo > rHi) {
+		return true; // this ring misses the grid, but a wider one may not
+	}
+	for (int side = 0; side < 2; side++) { // the top and bottom rows of the ring
+		int rr = (side == 0) ? r - ring : r + ring;
+		if (rr >= 0 && rr < m_rows) {
+			for (int cc = cLo; cc <= cHi; cc++) {
+				visit((size_t)rr * m_columns + cc);
+			}
+		}
+		if (ring == 0) {
+			return true;
+		}
+	}
+	for (int side = 0; side < 2; side++) { // and its left and right columns, between those
+		int cc = (side == 0) ? c - ring : c + ring;
+		if (cc >= 0 && cc < m_columns) {
+			for (int rr = max(r - ring + 1, 0); rr <= min(r + ring - 1, m_rows - 1); rr++) {
+				visit((size_t)rr * m_columns + cc);
+			}
+		}
+	}
+	return true;
+}
+
+unsigned int SpatialIndex::nearestNode(double latitude, double longitude, double* miles) const
+{
+	if (empty()) {
+		return StreetGraph::NO_NODE;
+	}
+	double px = x(longitude), py = y(latitude);
+	int c = column(px), r = row(py);
+	unsigned int best = StreetGraph::NO_NODE;
+	double bestSquared = numeric_limits<double>::infinity();
+	for (int ring = firstRing(c, r); ; ring++) {
+		  // the query lies somewhere in its own cell, so nothing in this ring or
+		  // beyond is closer than ring - 1 whole cells
+		double reach = max(ring - 1, 0) * m_cellSize;
+		if (best != StreetGraph::NO_NODE && bestSquared <= reach * reach) {
+			break;
+		}
+		bool more = visitRing(c, r, ring, [&](size_t cell) {
+			for (unsigned int k = m_nodeStart[cell]; k < m_nodeStart[cell + 1]; k++) {
+				unsigned int v = m_nodes[k];
+				double dx = x(m_graph->longitude(v)) - px, dy = y(m_graph->latitude(v)) - py;
+				double d = dx * dx + dy * dy;
+				if (d < bestSquared || (d == bestSquared && v < best)) {
+					bestSquared = d;
+					best = v;
+				}
+			}
+		});
+		if (!more) {
+			break;
+		}
+	}
+	if (miles != nullptr) {
+		*miles = distanceEarthMiles(latitude, longitude, m_graph->latitude(best), m_graph->longitude(best));
+	}
+	return best;
+}
+
+bool SpatialIndex::nearestSegment(double latitude, double longitude, SegmentSnap& snap) const
+{
+	if (empty() || m_edges.empty()) {
+		return false;
+	}
+	double px = x(longitude), py = y(latitude);
+	int c = column(px), r = row(py);
+	bool found = false;
+	double bestSquared = numeric_limits<double>::infinity();
+	for (int ring = firstRing(c, r); ; ring++) {
+		double reach = max(ring - 1, 0) * m_cellSize;
+		if (found && bestSquared <= reach * reach) {
+			break;
+		}
+		bool more = visitRing(c, r, ring, [&](size_t cell) {
+			for (unsigned int k = m_edgeStart[cell]; k < m_edgeStart[cell + 1]; k++) {
+				const StreetEdge& e = m_graph->edge(m_edges[k]);
+				double ax = x(m_graph->longitude(e.from)), ay = y(m_graph->latitude(e.from));
+				double bx = x(m_graph->longitude(e.to)), by = y(m_graph->latitude(e.to));
+				double dx = bx - ax, dy = by - ay;
+				double lengthSquared = dx * dx + dy * dy;
+				double t = (lengthSquared > 0) ? ((px - ax) * dx + (py - ay) * dy) / lengthSquared : 0;
+				t = max(0.0, min(1.0, t));
+				double qx = ax + t * dx - px, qy = ay + t * dy - py;
+				double d = qx * qx + qy * qy;
+				if (d < bestSquared || (found && d == bestSquared && m_edges[k] < snap.edge)) {
+					bestSquared = d;
+					found = true;
+					snap.edge = m_edges[k];
+					snap.fraction = t;
+				}
+			}
+		});
+		if (!more) {
+			break;
+		}
+	}
+	const StreetEdge& e = m_graph->edge(snap.edge);
+	snap.latitude = m_graph->latitude(e.from) + snap.fraction * (m_graph->latitude(e.to) - m_graph->latitude(e.from));
+	snap.longitude = m_graph->longitude(e.from) + snap.fraction * (m_graph->longitude(e.to) - m_graph->longitude(e.from));
+	snap.miles = distanceEarthMiles(latitude, longitude, snap.latitude, snap.longitude);
+	return true;
+}
+
+void SpatialIndex::nearestNodes(const vector<GeoCoord>& points, vector<unsigned int>& nodes,
+                                vector<double>* miles, unsigned int numThreads) const
+{
+	unsigned int count = (unsigned int)points.size();
+	nodes.assign(count, StreetGraph::NO_NODE);
+	if (miles != nullptr) {
+		miles->assign(count, numeric_limits<double>::infinity());
+	}
+	  // queries are cheap, so threads take them in blocks
+	const unsigned int BLOCK = 256;
+	if (numThreads == 0) {
+		numThreads = max(1u, thread::hardware_concurrency());
+	}
+	numThreads = max(1u, min(numThreads, (count + BLOCK - 1) / BLOCK));
+	atomic<unsigned int> nextBlock(0);
+	auto work = [&]() {
+		for (unsigned int first = BLOCK * nextBlock++; first < count; first = BLOCK * nextBlock++) {
+			for (unsigned int i = first; i < min(first + BLOCK, count); i++) {
+				nodes[i] = nearestNode(points[i].latitude, points[i].longitude, miles ? &(*miles)[i] : nullptr);
+			}
+		}
+	};
+	if (numThreads == 1) {
+		work();
+		return;
+	}
+	vector<thread> workers;
+	for (unsigned int i = 0; i < numThreads; i++) {
+		workers.push_back(thread(work));
+	}
+	for (thread& t : workers) {
+		t.join();
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef SPATIALINDEX_INCLUDED
+#define SPATIALINDEX_INCLUDED
+
+#include "provided.h"
+#include <vector>
+
+class StreetGraph;
+
+// Where a point lands on the nearest street segment
+struct SegmentSnap
+{
+	unsigned int edge;  // index of the edge in the graph's edge array
+	double fraction;    // how far along it, 0 at its from node and 1 at its to node
+	double latitude;    // the closest point itself
+	double longitude;
+	double miles;       // from the query point to that closest point
+};
+
+// A uniform grid over the map's intersections and street segments, so arbitrary
+// coordinates (customer addresses, GPS fixes) can be matched to the map without
+// scanning every node. Points are projected onto a flat plane scaled to miles at
+// the map's middle latitude, which is accurate to well under a percent across a
+// city. The grid is sized for about two nodes a cell; a query searches rings of
+// cells outward from its own until no unsearched cell can hold anything closer
+// than the best found, so it looks at a handful of cells wherever the map is
+// dense. Segments are filed under every cell their bounding box touches.
+//
+// Built from a loaded StreetGraph; the graph must outlive the index.
+class SpatialIndex
+{
+public:
+	SpatialIndex();
+
+	void build(const StreetGraph& g);
+	void clear();
+	bool empty() const { return m_graph == nullptr; }
+
+	  // the node closest to (latitude, longitude), or StreetGraph::NO_NODE if the
+	  // index is empty; miles, if not null, gets its great-circle distance
+	unsigned int nearestNode(double latitude, double longitude, double* miles = nullptr) const;
+	  // the closest point on any street segment; false if the index is empty
+	bool nearestSegment(double latitude, double longitude, SegmentSnap& snap) const;
+	  // nearestNode for every point at once, split over numThreads threads (0 means
+	  // one per core); miles, if not null, gets each distance
+	void nearestNodes(const std::vector<GeoCoord>& points, std::vector<unsigned int>& nodes,
+	                  std::vector<double>* miles, unsigned int numThreads) const;
+
+	  // We prevent a SpatialIndex object from being copied or assigned.
+	SpatialIndex(const SpatialIndex&) = delete;
+	SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+private:
+	double x(double longitude) const { return longitude * m_milesPerLonDegree; }
+	double y(double latitude) const { return latitude * m_milesPerLatDegree; }
+	int column(double px) const;
+	int row(double py) const;
+	  // the first ring around cell (column, row) that reaches the grid
+	int firstRing(int c, int r) const;
+	  // visit the grid cells of ring r around (column, row); returns false once
+	  // the rings inside it already cover the whole grid
+	template<class Visit>
+	bool visitRing(int c, int r, int ring, Visit visit) const;
+
+	const StreetGraph* m_graph;
+	double m_milesPerLatDegree;
+	double m_milesPerLonDegree;
+	double m_minX, m_minY;     // grid origin, in projected miles
+	double m_cellSize;         // side of a cell, in projected miles
+	int m_columns, m_rows;
+	std::vector<unsigned int> m_nodeStart; // nodes of cell i are m_nodes[m_nodeStart[i]..m_nodeStart[i+1])
+	std::vector<unsigned int> m_nodes;
+	std::vector<unsigned int> m_edgeStart; // likewise for edges, one direction of each segment
+	std::vector<unsigned int> m_edges;
+};
+
+#endif // SPATIALINDEX_INCLUDED
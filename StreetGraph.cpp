@@ -0,0 +1,578 @@
+#include "StreetGraph.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+  // FNV-1a over the slice's characters, so no string has to be built to probe
+unsigned int hasher(const TextSlice& t)
+{
+    unsigned int h = 2166136261u;
+    for (unsigned int i = 0; i < t.length; i++) {
+        h = (h ^ (unsigned char)t.text[i]) * 16777619u;
+    }
+    return h;
+}
+
+bool parseCoordUnits(const char* text, unsigned int length, int& units)
+{
+    const char* p = text;
+    const char* end = text + length;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    long long value = 0;
+    int digits = 0;
+    int fractionDigits = -1; // -1 until the decimal point is seen
+    for (; p != end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            if (fractionDigits >= 7) { // finer than 1e-7 degrees: only zeros are allowed
+                if (*p != '0')
+                    return false;
+                continue;
+            }
+            value = value * 10 + (*p - '0');
+            digits++;
+            if (fractionDigits >= 0)
+                fractionDigits++;
+            if (value > 2147483647LL)
+                return false;
+        }
+        else if (*p == '.' && fractionDigits < 0) {
+            fractionDigits = 0;
+        }
+        else {
+            return false;
+        }
+    }
+    if (digits == 0)
+        return false;
+    for (int i = max(fractionDigits, 0); i < 7; i++) { // scale up to whole units
+        value *= 10;
+        if (value > 2147483647LL)
+            return false;
+    }
+    units = (int)(negative ? -value : value);
+    return true;
+}
+
+bool coordKeyOf(const GeoCoord& gc, CoordKey& key)
+{
+    int lat, lon;
+    if (!parseCoordUnits(gc.latitudeText.data(), (unsigned int)gc.latitudeText.size(), lat) ||
+        !parseCoordUnits(gc.longitudeText.data(), (unsigned int)gc.longitudeText.size(), lon))
+        return false;
+    key = makeCoordKey(lat, lon);
+    return true;
+}
+
+//******************** StreetGraph functions **********************************
+
+const unsigned int StreetGraph::NO_NODE;
+
+StreetGraph::StreetGraph() {
+	clear();
+}
+
+void StreetGraph::clear() {
+	m_owned = OwnedArrays();
+	m_owned.offsets.assign(1, 0); // an empty graph still has its sentinel offset
+	m_snapshot.close();
+	m_extraSections.clear();
+	buildIndex();
+	bindOwnedArrays();
+}
+
+void StreetGraph::buildIndex() {
+	unsigned int numNodes = (unsigned int)m_owned.lat.size();
+	unsigned int tableSize = 8;
+	while (tableSize < 2 * numNodes) { // keep the table at most half full
+		tableSize *= 2;
+	}
+	m_owned.index.assign(tableSize, NO_NODE);
+	for (unsigned int n = 0; n < numNodes; n++) {
+		unsigned int slot = DefaultHash<CoordKey>()(m_owned.keys[n]) & (tableSize - 1);
+		while (m_owned.index[slot] != NO_NODE) { // linear probing
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		m_owned.index[slot] = n;
+	}
+}
+
+void StreetGraph::bindOwnedArrays() {
+	m_numNodes = (unsigned int)m_owned.lat.size();
+	m_numEdges = (unsigned int)m_owned.edges.size();
+	m_numNames = (unsigned int)m_owned.nameOffsets.size();
+	m_indexMask = (unsigned int)m_owned.index.size() - 1;
+	m_coordTextSize = m_owned.coordText.size();
+	m_nameTextSize = m_owned.nameText.size();
+	m_offsets = m_owned.offsets.data();
+	m_edges = m_owned.edges.data();
+	m_lat = m_owned.lat.data();
+	m_lon = m_owned.lon.data();
+	m_keys = m_owned.keys.data();
+	m_coordTextOffsets = m_owned.coordTextOffsets.data();
+	m_coordText = m_owned.coordText.data();
+	m_nameOffsets = m_owned.nameOffsets.data();
+	m_nameText = m_owned.nameText.data();
+	m_index = m_owned.index.data();
+}
+
+unsigned int StreetGraph::findNode(const GeoCoord& gc) const {
+	CoordKey key;
+	if (!coordKeyOf(gc, key)) {
+		return NO_NODE;
+	}
+	return findNode(key);
+}
+
+unsigned int StreetGraph::findNode(CoordKey key) const {
+	unsigned int slot = DefaultHash<CoordKey>()(key) & m_indexMask; // same hash the maps use for CoordKeys
+	while (m_index[slot] != NO_NODE) {
+		if (m_keys[m_index[slot]] == key) {
+			return m_index[slot];
+		}
+		slot = (slot + 1) & m_indexMask;
+	}
+	return NO_NODE;
+}
+
+const char* StreetGraph::longitudeText(unsigned int node) const {
+	const char* lat = latitudeText(node);
+	while (*lat != '\0') { // longitude text starts right after the latitude's terminator
+		lat++;
+	}
+	return lat + 1;
+}
+
+GeoCoord StreetGraph::coord(unsigned int node) const {
+	return GeoCoord(latitudeText(node), longitudeText(node));
+}
+
+const StreetEdge* StreetGraph::reverseOf(const StreetEdge& e) const {
+	for (const StreetEdge& r : edgesFrom(e.to)) { // every segment was loaded in both directions
+		if (r.to == e.from && r.nameId == e.nameId && r.length == e.length) {
+			return &r;
+		}
+	}
+	return nullptr;
+}
+
+StreetSegment StreetGraph::segment(const StreetEdge& e) const {
+	return StreetSegment(coord(e.from), coord(e.to), streetName(e.nameId));
+}
+
+//******************** snapshot files *****************************************
+
+// On-disk layout: SnapshotHeader, sectionCount SnapshotEntry records, then the
+// sections themselves, each starting on an 8-byte boundary. Everything is in the
+// writing machine's byte order; byteOrderMark rejects files from the other kind.
+struct SnapshotHeader
+{
+	char magic[8];
+	unsigned int byteOrderMark;
+	unsigned int version;
+	unsigned int numNodes;
+	unsigned int numEdges;
+	unsigned int numNames;
+	unsigned int sectionCount;
+};
+
+struct SnapshotEntry
+{
+	unsigned int id;
+	unsigned int reserved;
+	unsigned long long offset;
+	unsigned long long size;
+};
+
+static const char SNAPSHOT_MAGIC[8] = { 'G', 'O', 'O', 'B', 'M', 'A', 'P', '\0' };
+static const unsigned int SNAPSHOT_BYTE_ORDER = 0x01020304u;
+
+bool StreetGraph::isSnapshot(const char* data, size_t size) {
+	return size >= sizeof(SnapshotHeader) && char_traits<char>::compare(data, SNAPSHOT_MAGIC, 8) == 0;
+}
+
+template<typename T>
+static SnapshotSection sectionOf(unsigned int id, const T* data, size_t count)
+{
+	SnapshotSection s;
+	s.id = id;
+	s.data = reinterpret_cast<const char*>(data);
+	s.size = count * sizeof(T);
+	return s;
+}
+
+bool StreetGraph::saveSnapshot(const string& fileName, const vector<SnapshotSection>& extra) const {
+	vector<SnapshotSection> sections;
+	sections.push_back(sectionOf(SECTION_OFFSETS, m_offsets, m_numNodes + 1));
+	sections.push_back(sectionOf(SECTION_EDGES, m_edges, m_numEdges));
+	sections.push_back(sectionOf(SECTION_LATITUDES, m_lat, m_numNodes));
+	sections.push_back(sectionOf(SECTION_LONGITUDES, m_lon, m_numNodes));
+	sections.push_back(sectionOf(SECTION_COORD_TEXT_OFFSETS, m_coordTextOffsets, m_numNodes));
+	sections.push_back(sectionOf(SECTION_COORD_TEXT, m_coordText, m_coordTextSize));
+	sections.push_back(sectionOf(SECTION_NAME_OFFSETS, m_nameOffsets, m_numNames));
+	sections.push_back(sectionOf(SECTION_NAME_TEXT, m_nameText, m_nameTextSize));
+	sections.push_back(sectionOf(SECTION_NODE_INDEX, m_index, m_indexMask + 1));
+	sections.push_back(sectionOf(SECTION_NODE_KEYS, m_keys, m_numNodes));
+	sections.insert(sections.end(), extra.begin(), extra.end());
+
+	SnapshotHeader header;
+	char_traits<char>::copy(header.magic, SNAPSHOT_MAGIC, 8);
+	header.byteOrderMark = SNAPSHOT_BYTE_ORDER;
+	header.version = SNAPSHOT_VERSION;
+	header.numNodes = m_numNodes;
+	header.numEdges = m_numEdges;
+	header.numNames = m_numNames;
+	header.sectionCount = (unsigned int)sections.size();
+
+	vector<SnapshotEntry> entries;
+	unsigned long long offset = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotEntry);
+	for (const SnapshotSection& section : sections) {
+		offset = (offset + 7) & ~7ull;
+		SnapshotEntry entry;
+		entry.id = section.id;
+		entry.reserved = 0;
+		entry.offset = offset;
+		entry.size = section.size;
+		entries.push_back(entry);
+		offset += section.size;
+	}
+
+	ofstream out(fileName, ios::binary | ios::trunc);
+	if (!out) {
+		std::cerr << "Unable to create " << fileName << endl;
+		return false;
+	}
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SnapshotEntry));
+	unsigned long long written = sizeof(SnapshotHeader) + entries.size() * sizeof(SnapshotEntry);
+	static const char padding[8] = { 0 };
+	for (unsigned int i = 0; i < sections.size(); i++) {
+		out.write(padding, entries[i].offset - written);
+		out.write(sections[i].data, sections[i].size);
+		written = entries[i].offset + entries[i].size;
+	}
+	if (!out) {
+		std::cerr << "Error writing " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+bool StreetGraph::loadSnapshot(const string& fileName) {
+	clear();
+	if (!m_snapshot.open(fileName) || !isSnapshot(m_snapshot.data(), m_snapshot.size())) {
+		std::cerr << fileName << " is not a map snapshot" << endl;
+		clear();
+		return false;
+	}
+	const char* base = m_snapshot.data();
+	const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(base);
+	if (header->byteOrderMark != SNAPSHOT_BYTE_ORDER || header->version != SNAPSHOT_VERSION) {
+		std::cerr << fileName << " was written by an incompatible version or machine; rebuild it from the text map" << endl;
+		clear();
+		return false;
+	}
+	unsigned long long tableEnd = sizeof(SnapshotHeader) + (unsigned long long)header->sectionCount * sizeof(SnapshotEntry);
+	if (tableEnd > m_snapshot.size()) {
+		std::cerr << fileName << " is truncated" << endl;
+		clear();
+		return false;
+	}
+
+	// point the views at the sections; only their sizes are checked, nothing is copied
+	unsigned int numNodes = header->numNodes;
+	unsigned int numEdges = header->numEdges;
+	unsigned int numNames = header->numNames;
+	const SnapshotEntry* entries = reinterpret_cast<const SnapshotEntry*>(base + sizeof(SnapshotHeader));
+	unsigned int found = 0;
+	size_t coordTextSize = 0, nameTextSize = 0, indexSize = 0;
+	for (unsigned int i = 0; i < header->sectionCount; i++) {
+		const SnapshotEntry& e = entries[i];
+		if (e.offset % 8 != 0 || e.offset > m_snapshot.size() || e.size > m_snapshot.size() - e.offset) {
+			std::cerr << fileName << " is truncated" << endl;
+			clear();
+			return false;
+		}
+		const char* data = base + e.offset;
+		bool sizeOk = true;
+		switch (e.id) {
+		case SECTION_OFFSETS:
+			m_offsets = reinterpret_cast<const unsigned int*>(data);
+			sizeOk = e.size == (numNodes + 1ull) * sizeof(unsigned int);
+			break;
+		case SECTION_EDGES:
+			m_edges = reinterpret_cast<const StreetEdge*>(data);
+			sizeOk = e.size == numEdges * (unsigned long long)sizeof(StreetEdge);
+			break;
+		case SECTION_LATITUDES:
+			m_lat = reinterpret_cast<const double*>(data);
+			sizeOk = e.size == numNodes * (unsigned long long)sizeof(double);
+			break;
+		case SECTION_LONGITUDES:
+			m_lon = reinterpret_cast<const double*>(data);
+			sizeOk = e.size == numNodes * (unsigned long long)sizeof(double);
+			break;
+		case SECTION_COORD_TEXT_OFFSETS:
+			m_coordTextOffsets = reinterpret_cast<const unsigned int*>(data);
+			sizeOk = e.size == numNodes * (unsigned long long)sizeof(unsigned int);
+			break;
+		case SECTION_COORD_TEXT:
+			m_coordText = data;
+			coordTextSize = (size_t)e.size;
+			break;
+		case SECTION_NAME_OFFSETS:
+			m_nameOffsets = reinterpret_cast<const unsigned int*>(data);
+			sizeOk = e.size == numNames * (unsigned long long)sizeof(unsigned int);
+			break;
+		case SECTION_NAME_TEXT:
+			m_nameText = data;
+			nameTextSize = (size_t)e.size;
+			break;
+		case SECTION_NODE_KEYS:
+			m_keys = reinterpret_cast<const CoordKey*>(data);
+			sizeOk = e.size == numNodes * (unsigned long long)sizeof(CoordKey);
+			break;
+		case SECTION_NODE_INDEX:
+			m_index = reinterpret_cast<const unsigned int*>(data);
+			indexSize = (size_t)(e.size / sizeof(unsigned int));
+			break;
+		default: { // precomputed data for someone else
+			SnapshotSection extra;
+			extra.id = e.id;
+			extra.data = data;
+			extra.size = (size_t)e.size;
+			m_extraSections.push_back(extra);
+			continue;
+		}
+		}
+		if (!sizeOk) {
+			std::cerr << fileName << " has a malformed section " << e.id << endl;
+			clear();
+			return false;
+		}
+		found |= 1u << e.id;
+	}
+
+	const unsigned int required = (1u << (SECTION_NODE_KEYS + 1)) - 2;
+	bool textOk = (numNodes == 0 || (coordTextSize > 0 && m_coordText[coordTextSize - 1] == '\0'))
+		&& (numNames == 0 || (nameTextSize > 0 && m_nameText[nameTextSize - 1] == '\0'));
+	if (found != required || !textOk || indexSize < 8 || (indexSize & (indexSize - 1)) != 0
+		|| m_offsets[numNodes] != numEdges) {
+		std::cerr << fileName << " is missing part of the graph" << endl;
+		clear();
+		return false;
+	}
+	m_numNodes = numNodes;
+	m_numEdges = numEdges;
+	m_numNames = numNames;
+	m_indexMask = (unsigned int)indexSize - 1;
+	m_coordTextSize = coordTextSize;
+	m_nameTextSize = nameTextSize;
+	if (!validate()) {
+		std::cerr << fileName << " is corrupt: its graph arrays don't agree" << endl;
+		clear();
+		return false;
+	}
+	return true;
+}
+
+bool StreetGraph::validate() const {
+	// edge runs: offsets climb from 0 to the edge count, and every edge in node
+	// v's run leaves v for a real node along a real street
+	if (m_offsets[0] != 0) {
+		return false;
+	}
+	for (unsigned int v = 0; v < m_numNodes; v++) {
+		if (m_offsets[v + 1] < m_offsets[v] || m_offsets[v + 1] > m_numEdges) {
+			return false;
+		}
+		for (unsigned int i = m_offsets[v]; i < m_offsets[v + 1]; i++) {
+			const StreetEdge& e = m_edges[i];
+			if (e.from != v || e.to >= m_numNodes || e.nameId >= m_numNames || !(e.length >= 0 && isfinite(e.length))) {
+				return false;
+			}
+		}
+	}
+	// every segment runs both ways, as the loader adds it, so searches that walk
+	// edges backward (bidirectional A*, the hierarchy) can always turn them round
+	for (unsigned int i = 0; i < m_numEdges; i++) {
+		if (reverseOf(m_edges[i]) == nullptr) {
+			return false;
+		}
+	}
+	// coordinates, and each node's "lat\0lon\0" text inside the text section
+	for (unsigned int v = 0; v < m_numNodes; v++) {
+		if (!(fabs(m_lat[v]) <= 90) || !(fabs(m_lon[v]) <= 180) || m_coordTextOffsets[v] >= m_coordTextSize) {
+			return false;
+		}
+		size_t latLength = strlen(m_coordText + m_coordTextOffsets[v]); // the section ends in '\0'
+		if (m_coordTextOffsets[v] + latLength + 1 >= m_coordTextSize) {
+			return false; // no room left for the longitude
+		}
+	}
+	for (unsigned int n = 0; n < m_numNames; n++) {
+		if (m_nameOffsets[n] >= m_nameTextSize) {
+			return false;
+		}
+	}
+	// the node index holds node ids and has a free slot to end every probe
+	bool anyFree = false;
+	for (unsigned int slot = 0; slot <= m_indexMask; slot++) {
+		if (m_index[slot] == NO_NODE) {
+			anyFree = true;
+		}
+		else if (m_index[slot] >= m_numNodes) {
+			return false;
+		}
+	}
+	return anyFree;
+}
+
+bool StreetGraph::findSnapshotSection(unsigned int id, SnapshotSection& section) const {
+	for (const SnapshotSection& s : m_extraSections) {
+		if (s.id == id) {
+			section = s;
+			return true;
+		}
+	}
+	return false;
+}
+
+//******************** StreetGraphBuilder functions ***************************
+
+StreetGraphBuilder::StreetGraphBuilder() {
+	m_lastNameId = 0;
+}
+
+unsigned int StreetGraphBuilder::addNode(CoordKey key, const CoordText& text) {
+	unsigned int newId = (unsigned int)m_nodes.size();
+	pair<unsigned int*, bool> id = m_nodeIds.try_emplace(key, newId); // one probe finds or claims the key
+	if (!id.second) {
+		return *id.first;
+	}
+	Node n;
+	n.key = key;
+	n.text = text;
+	  // whole units over an exact power of ten round exactly like std::stod on the text
+	n.lat = latitudeUnits(key) / COORD_UNITS_PER_DEGREE;
+	n.lon = longitudeUnits(key) / COORD_UNITS_PER_DEGREE;
+	m_nodes.push_back(n);
+	return newId;
+}
+
+unsigned int StreetGraphBuilder::addName(const TextSlice& name) {
+	if (!m_names.empty() && name == m_names[m_lastNameId]) { // segments of a street arrive together
+		return m_lastNameId;
+	}
+	pair<unsigned int*, bool> id = m_nameIds.try_emplace(name, (unsigned int)m_names.size());
+	if (id.second) {
+		m_names.push_back(name);
+	}
+	m_lastNameId = *id.first;
+	return m_lastNameId;
+}
+
+void StreetGraphBuilder::addSegment(unsigned int start, unsigned int end, unsigned int nameId) {
+	// the reverse edge goes first so adjacency order matches the order segments were read in
+	StreetEdge reverseEdge = StreetEdge();
+	reverseEdge.from = end;
+	reverseEdge.to = start;
+	reverseEdge.nameId = nameId;
+	reverseEdge.length = distanceEarthMiles(m_nodes[end].lat, m_nodes[end].lon, m_nodes[start].lat, m_nodes[start].lon);
+	m_edges.push_back(reverseEdge);
+
+	StreetEdge edge = StreetEdge();
+	edge.from = start;
+	edge.to = end;
+	edge.nameId = nameId;
+	edge.length = distanceEarthMiles(m_nodes[start].lat, m_nodes[start].lon, m_nodes[end].lat, m_nodes[end].lon);
+	m_edges.push_back(edge);
+}
+
+void StreetGraphBuilder::append(StreetGraphBuilder& part) {
+	// part's ids are local to it; first appearances stay in order, so the merged
+	// builder numbers nodes exactly as one builder reading both inputs would
+	vector<unsigned int> nodeIds(part.m_nodes.size());
+	for (unsigned int i = 0; i < part.m_nodes.size(); i++) {
+		const Node& n = part.m_nodes[i];
+		nodeIds[i] = addNode(n.key, n.text);
+	}
+	vector<unsigned int> nameIds(part.m_names.size());
+	for (unsigned int i = 0; i < part.m_names.size(); i++) {
+		nameIds[i] = addName(part.m_names[i]);
+	}
+	m_edges.reserve(m_edges.size() + part.m_edges.size());
+	for (StreetEdge e : part.m_edges) { // lengths were already computed by the part
+		e.from = nodeIds[e.from];
+		e.to = nodeIds[e.to];
+		e.nameId = nameIds[e.nameId];
+		m_edges.push_back(e);
+	}
+
+	part.m_nodes.clear();
+	part.m_names.clear();
+	part.m_edges.clear();
+	part.m_nodeIds.reset();
+	part.m_nameIds.reset();
+	part.m_lastNameId = 0;
+}
+
+void StreetGraphBuilder::build(StreetGraph& g) {
+	g.clear();
+	StreetGraph::OwnedArrays& out = g.m_owned;
+	unsigned int numNodes = (unsigned int)m_nodes.size();
+
+	// counting sort of the edges by from node; stable, so each node keeps its read order
+	out.offsets.assign(numNodes + 1, 0);
+	for (const StreetEdge& e : m_edges) {
+		out.offsets[e.from + 1]++;
+	}
+	for (unsigned int n = 0; n < numNodes; n++) {
+		out.offsets[n + 1] += out.offsets[n];
+	}
+	out.edges.resize(m_edges.size());
+	vector<unsigned int> next(out.offsets.begin(), out.offsets.end() - 1);
+	for (const StreetEdge& e : m_edges) {
+		out.edges[next[e.from]++] = e;
+	}
+
+	out.lat.reserve(numNodes);
+	out.lon.reserve(numNodes);
+	out.keys.reserve(numNodes);
+	out.coordTextOffsets.reserve(numNodes);
+	for (const Node& n : m_nodes) {
+		out.lat.push_back(n.lat);
+		out.lon.push_back(n.lon);
+		out.keys.push_back(n.key);
+		out.coordTextOffsets.push_back((unsigned int)out.coordText.size());
+		out.coordText.insert(out.coordText.end(), n.text.lat.text, n.text.lat.text + n.text.lat.length);
+		out.coordText.push_back('\0');
+		out.coordText.insert(out.coordText.end(), n.text.lon.text, n.text.lon.text + n.text.lon.length);
+		out.coordText.push_back('\0');
+	}
+
+	for (const TextSlice& name : m_names) {
+		out.nameOffsets.push_back((unsigned int)out.nameText.size());
+		out.nameText.insert(out.nameText.end(), name.text, name.text + name.length);
+		out.nameText.push_back('\0');
+	}
+
+	g.buildIndex(); // the text pool is final now, so the index can point into it
+	g.bindOwnedArrays();
+
+	m_nodes.clear();
+	m_names.clear();
+	m_edges.clear();
+	m_nodeIds.reset();
+	m_nameIds.reset();
+	m_lastNameId = 0;
+}
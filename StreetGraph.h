@@ -0,0 +1,256 @@
+#ifndef STREETGRAPH_INCLUDED
+#define STREETGRAPH_INCLUDED
+
+#include "provided.h"
+#include "OpenHashMap.h"
+#include "MappedFile.h"
+#include <vector>
+#include <string>
+
+// Same haversine distance as distanceEarthMiles(GeoCoord, GeoCoord), but on raw
+// degrees so hot loops don't have to build GeoCoords (and their strings).
+inline double distanceEarthMiles(double lat1d, double lon1d, double lat2d, double lon2d)
+{
+	static const double earthRadiusKm = 6371.0;
+	const double milesPerKm = 1 / 1.609344;
+	double lat1r = deg2rad(lat1d);
+	double lon1r = deg2rad(lon1d);
+	double lat2r = deg2rad(lat2d);
+	double lon2r = deg2rad(lon2d);
+	double u = std::sin((lat2r - lat1r) / 2);
+	double v = std::sin((lon2r - lon1r) / 2);
+	return 2.0 * earthRadiusKm * std::asin(std::sqrt(u * u + std::cos(lat1r) * std::cos(lat2r) * v * v)) * milesPerKm;
+}
+
+// A run of characters that lives in someone else's buffer (the mapped map file
+// while loading, the graph's text pool afterwards). Never owns its text.
+struct TextSlice
+{
+	const char* text;
+	unsigned int length;
+};
+
+inline bool operator==(const TextSlice& lhs, const TextSlice& rhs)
+{
+	return lhs.length == rhs.length && std::char_traits<char>::compare(lhs.text, rhs.text, lhs.length) == 0;
+}
+
+// The latitude and longitude text of a coordinate
+struct CoordText
+{
+	TextSlice lat;
+	TextSlice lon;
+};
+
+// Internally a coordinate is identified by its latitude and longitude in whole
+// 1e-7 degree units (the precision of the map data), packed latitude-high into
+// one 64-bit integer. Equal keys mean numerically equal coordinates, so
+// "34.05" and "34.0500000" name the same node; the text form is only kept for
+// handing GeoCoords back out through the public API.
+typedef unsigned long long CoordKey;
+
+const double COORD_UNITS_PER_DEGREE = 1e7;
+
+inline CoordKey makeCoordKey(int latUnits, int lonUnits)
+{
+	return ((CoordKey)(unsigned int)latUnits << 32) | (unsigned int)lonUnits;
+}
+
+inline int latitudeUnits(CoordKey key) { return (int)(unsigned int)(key >> 32); }
+inline int longitudeUnits(CoordKey key) { return (int)(unsigned int)key; }
+
+  // parse [-]digits[.digits] into 1e-7 degree units; fails on anything finer
+  // than that (other than trailing zeros) or outside the int range
+bool parseCoordUnits(const char* text, unsigned int length, int& units);
+
+  // the key of gc's text, or false if it can't be a map coordinate
+bool coordKeyOf(const GeoCoord& gc, CoordKey& key);
+
+// A directed edge of the road graph. Every street segment in the map file
+// becomes two of these (start -> end and end -> start).
+struct StreetEdge
+{
+	unsigned int from;   // node id the edge leaves
+	unsigned int to;     // node id the edge enters
+	unsigned int nameId; // index into the graph's street name table
+	unsigned int unused; // always 0; spells out the padding so snapshots are reproducible
+	double length;       // in miles
+};
+
+// A read-only view of the outgoing edges of one node. It points straight into
+// the graph's edge array, so it is only valid while the StreetMap is loaded.
+struct EdgeRange
+{
+	const StreetEdge* first;
+	const StreetEdge* last;
+
+	const StreetEdge* begin() const { return first; }
+	const StreetEdge* end() const { return last; }
+	unsigned int size() const { return (unsigned int)(last - first); }
+	bool empty() const { return first == last; }
+};
+
+// Binary snapshots (see StreetGraph::saveSnapshot) are a header, a section
+// table, and 8-byte aligned sections that are used in place once mapped.
+const unsigned int SNAPSHOT_VERSION = 2;
+
+enum SnapshotSectionId
+{
+	SECTION_OFFSETS = 1, SECTION_EDGES, SECTION_LATITUDES, SECTION_LONGITUDES,
+	SECTION_COORD_TEXT_OFFSETS, SECTION_COORD_TEXT, SECTION_NAME_OFFSETS, SECTION_NAME_TEXT,
+	SECTION_NODE_INDEX, SECTION_NODE_KEYS
+	  // ids from 16 up hold precomputed routing data owned by other components
+};
+
+// A section other components want written to (or found in) a snapshot.
+struct SnapshotSection
+{
+	unsigned int id;
+	const char* data;
+	size_t size;
+};
+
+// Compressed-sparse-row road graph. Nodes are numbered 0..numNodes()-1, and the
+// outgoing edges of node n are the contiguous run edges[offsets[n]..offsets[n+1]).
+// The arrays either belong to the graph (after a text map is built) or live in a
+// mapped snapshot file, and every accessor reads them the same way.
+class StreetGraph
+{
+public:
+	static const unsigned int NO_NODE = 0xFFFFFFFFu;
+
+	StreetGraph();
+	void clear();
+
+	unsigned int numNodes() const { return m_numNodes; }
+	unsigned int numEdges() const { return m_numEdges; }
+	unsigned int numNames() const { return m_numNames; }
+
+	  // returns the id of the node at gc, or NO_NODE if gc isn't a segment endpoint
+	unsigned int findNode(const GeoCoord& gc) const;
+	unsigned int findNode(CoordKey key) const;
+	CoordKey key(unsigned int node) const { return m_keys[node]; }
+
+	double latitude(unsigned int node) const { return m_lat[node]; }
+	double longitude(unsigned int node) const { return m_lon[node]; }
+	const char* latitudeText(unsigned int node) const { return m_coordText + m_coordTextOffsets[node]; }
+	const char* longitudeText(unsigned int node) const;
+	GeoCoord coord(unsigned int node) const;
+	double distanceMiles(unsigned int a, unsigned int b) const
+	{
+		return distanceEarthMiles(m_lat[a], m_lon[a], m_lat[b], m_lon[b]);
+	}
+
+	const char* streetName(unsigned int nameId) const { return m_nameText + m_nameOffsets[nameId]; }
+
+	EdgeRange edgesFrom(unsigned int node) const
+	{
+		EdgeRange r;
+		r.first = m_edges + m_offsets[node];
+		r.last = m_edges + m_offsets[node + 1];
+		return r;
+	}
+
+	const StreetEdge& edge(unsigned int index) const { return m_edges[index]; }
+	unsigned int edgeIndex(const StreetEdge& e) const { return (unsigned int)(&e - m_edges); }
+
+	  // the edge running the other way along the same street segment
+	const StreetEdge* reverseOf(const StreetEdge& e) const;
+
+	  // materialize an edge as the StreetSegment the public API hands out
+	StreetSegment segment(const StreetEdge& e) const;
+
+	  // true if the buffer starts with a snapshot header
+	static bool isSnapshot(const char* data, size_t size);
+	  // write the graph, plus any extra sections, as a versioned binary snapshot
+	bool saveSnapshot(const std::string& fileName, const std::vector<SnapshotSection>& extra) const;
+	  // map a snapshot and use its arrays in place; false if it is missing or invalid
+	bool loadSnapshot(const std::string& fileName);
+	  // look up a section the graph itself doesn't use (only set after loadSnapshot)
+	bool findSnapshotSection(unsigned int id, SnapshotSection& section) const;
+
+	  // We prevent a StreetGraph object from being copied or assigned.
+	StreetGraph(const StreetGraph&) = delete;
+	StreetGraph& operator=(const StreetGraph&) = delete;
+
+private:
+	friend class StreetGraphBuilder;
+
+	struct OwnedArrays {
+		std::vector<unsigned int> offsets;          // numNodes + 1 entries
+		std::vector<StreetEdge> edges;              // grouped by from node
+		std::vector<double> lat;
+		std::vector<double> lon;
+		std::vector<CoordKey> keys;
+		std::vector<unsigned int> coordTextOffsets; // "lat\0lon\0" per node
+		std::vector<char> coordText;
+		std::vector<unsigned int> nameOffsets;      // "name\0" per street name
+		std::vector<char> nameText;
+		std::vector<unsigned int> index;            // open-addressed node ids, power-of-two size
+	};
+
+	void buildIndex();
+	void bindOwnedArrays();
+	  // check that a mapped snapshot's arrays agree with each other, so that no
+	  // accessor can read outside them; done once, when the snapshot is loaded
+	bool validate() const;
+
+	OwnedArrays m_owned;
+	MappedFile m_snapshot;
+	std::vector<SnapshotSection> m_extraSections;
+
+	  // views used by every accessor, whichever storage backs them
+	unsigned int m_numNodes;
+	unsigned int m_numEdges;
+	unsigned int m_numNames;
+	unsigned int m_indexMask;
+	size_t m_coordTextSize;
+	size_t m_nameTextSize;
+	const unsigned int* m_offsets;
+	const StreetEdge* m_edges;
+	const double* m_lat;
+	const double* m_lon;
+	const CoordKey* m_keys;
+	const unsigned int* m_coordTextOffsets;
+	const char* m_coordText;
+	const unsigned int* m_nameOffsets;
+	const char* m_nameText;
+	const unsigned int* m_index;
+};
+
+// Collects nodes, names and segments while a map is being read, then lays
+// them out as a StreetGraph in one pass. Text is passed in as slices of the
+// caller's buffer, which must stay alive until build() returns.
+class StreetGraphBuilder
+{
+public:
+	StreetGraphBuilder();
+	unsigned int addNode(CoordKey key, const CoordText& text);
+	unsigned int addName(const TextSlice& name);
+	  // adds the end -> start and start -> end edges of one street segment
+	void addSegment(unsigned int start, unsigned int end, unsigned int nameId);
+	  // folds in everything another builder collected, as if it had been added here
+	  // after what is already here, and leaves that builder empty
+	void append(StreetGraphBuilder& part);
+	  // moves everything collected so far into g and leaves the builder empty
+	void build(StreetGraph& g);
+
+	StreetGraphBuilder(const StreetGraphBuilder&) = delete;
+	StreetGraphBuilder& operator=(const StreetGraphBuilder&) = delete;
+
+private:
+	struct Node {
+		CoordKey key;
+		CoordText text;
+		double lat;
+		double lon;
+	};
+	std::vector<Node> m_nodes;
+	std::vector<TextSlice> m_names;
+	std::vector<StreetEdge> m_edges;
+	OpenHashMap<CoordKey, unsigned int> m_nodeIds;
+	OpenHashMap<TextSlice, unsigned int> m_nameIds;
+	unsigned int m_lastNameId;
+};
+
+#endif // STREETGRAPH_INCLUDED
@@ -1,16 +1,196 @@
 #include "provided.h"
-#include "ExpandableHashMap.h"
+#include "StreetGraph.h"
+#include "ContractionHierarchy.h"
+#include "LandmarkTable.h"
+#include "RouteCache.h"
+#include "SpatialIndex.h"
+#include "MappedFile.h"
 #include <string>
 #include <vector>
 #include <functional>
-#include <fstream>
+#include <memory>
+#include <thread>
+#include <algorithm>
 #include <iostream>
-#include <iomanip>
+#include <climits>
 using namespace std;
 
-unsigned int hasher(const GeoCoord& g)
+// Hand-written scanner for the fixed mapdata.txt layout:
+//   street name
+//   number of segments
+//   startLat startLon endLat endLon     (once per segment)
+// It works directly on the mapped file and hands text slices to the graph
+// builder, so no std::string is created per token.
+
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+  // advance p to the next non-blank character on the current line
+static const char* skipBlanks(const char* p, const char* end)
 {
-    return std::hash<string>()(g.latitudeText + g.longitudeText);
+    while (p != end && isBlank(*p))
+        p++;
+    return p;
+}
+
+  // advance p past the end of the current line
+static const char* skipLine(const char* p, const char* end)
+{
+    while (p != end && *p != '\n')
+        p++;
+    return p == end ? end : p + 1;
+}
+
+  // read the next whitespace-delimited token on the current line
+static bool scanToken(const char*& p, const char* end, TextSlice& token)
+{
+    p = skipBlanks(p, end);
+    const char* first = p;
+    while (p != end && *p != '\n' && !isBlank(*p))
+        p++;
+    token.text = first;
+    token.length = (unsigned int)(p - first);
+    return token.length > 0;
+}
+
+static bool scanCount(const char*& p, const char* end, int& count)
+{
+    TextSlice token;
+    if (!scanToken(p, end, token))
+        return false;
+    unsigned long long value = 0;
+    for (unsigned int i = 0; i < token.length; i++) {
+        if (token.text[i] < '0' || token.text[i] > '9')
+            return false;
+        value = value * 10 + (token.text[i] - '0');
+        if (value > INT_MAX) // too big for a count, and stopping here keeps value from overflowing
+            return false;
+    }
+    count = (int)value;
+    return true;
+}
+
+  // read one coordinate as fixed-point units; the text is kept only to hand back out later
+static bool scanCoord(const char*& p, const char* end, StreetGraphBuilder& builder, unsigned int& node)
+{
+    CoordText text;
+    int lat, lon;
+    if (!scanToken(p, end, text.lat) || !parseCoordUnits(text.lat.text, text.lat.length, lat) ||
+        !scanToken(p, end, text.lon) || !parseCoordUnits(text.lon.text, text.lon.length, lon))
+        return false;
+    node = builder.addNode(makeCoordKey(lat, lon), text);
+    return true;
+}
+
+  // parse every street record in [p, end) into the builder
+static bool parseMapText(const char* p, const char* end, StreetGraphBuilder& builder)
+{
+    while (p != end) {
+        // street name: the rest of the line, minus a trailing carriage return
+        const char* lineEnd = p;
+        while (lineEnd != end && *lineEnd != '\n')
+            lineEnd++;
+        TextSlice name;
+        name.text = p;
+        name.length = (unsigned int)(lineEnd - p);
+        while (name.length > 0 && name.text[name.length - 1] == '\r')
+            name.length--;
+        p = (lineEnd == end) ? end : lineEnd + 1;
+        if (name.length == 0)
+            continue; // tolerate blank lines between records and at the end of the file
+
+        int numSegs;
+        if (!scanCount(p, end, numSegs)) {
+            std::cerr << "Bad segment count for street " << string(name.text, name.length) << endl;
+            return false;
+        }
+        p = skipLine(p, end);
+        unsigned int nameId = builder.addName(name);
+        for (int i = 0; i < numSegs; i++) {
+            unsigned int startNode, endNode;
+            if (!scanCoord(p, end, builder, startNode) || !scanCoord(p, end, builder, endNode)) {
+                std::cerr << "Bad segment coordinates for street " << string(name.text, name.length) << endl;
+                return false;
+            }
+            p = skipLine(p, end);
+            builder.addSegment(startNode, endNode, nameId); // adds the street and its reverse
+        }
+    }
+    return true;
+}
+
+  // true if [p, end) starts with a line of four coordinate numbers
+static bool isCoordLine(const char* p, const char* end)
+{
+    for (int i = 0; i < 4; i++) {
+        TextSlice token;
+        int units;
+        if (!scanToken(p, end, token) || !parseCoordUnits(token.text, token.length, units))
+            return false;
+    }
+    p = skipBlanks(p, end);
+    return p == end || *p == '\n';
+}
+
+  // true if [p, end) starts with a line holding just a segment count
+static bool isCountLine(const char* p, const char* end, int& count)
+{
+    if (!scanCount(p, end, count))
+        return false;
+    p = skipBlanks(p, end);
+    return p == end || *p == '\n';
+}
+
+  // find the first street record starting at or after p: a line that isn't a
+  // coordinate line, followed by a count line, followed by a coordinate line
+static const char* nextRecordStart(const char* p, const char* begin, const char* end)
+{
+    if (p != begin && p[-1] != '\n')
+        p = skipLine(p, end);
+    while (p != end) {
+        const char* countLine = skipLine(p, end);
+        int count;
+        if (!isCoordLine(p, end) && skipBlanks(p, end) != countLine && isCountLine(countLine, end, count)) {
+            const char* firstSeg = skipLine(countLine, end);
+            if (count == 0 || isCoordLine(firstSeg, end))
+                return p;
+        }
+        p = countLine;
+    }
+    return end;
+}
+
+  // parse the file on several threads: split it on street record boundaries, let
+  // each thread fill its own builder, then merge them in file order
+static bool parseMapTextParallel(const char* begin, const char* end, unsigned int numChunks, StreetGraphBuilder& builder)
+{
+    vector<const char*> bounds(numChunks + 1);
+    bounds[0] = begin;
+    for (unsigned int i = 1; i < numChunks; i++) {
+        const char* guess = begin + (end - begin) / numChunks * i;
+        bounds[i] = max(bounds[i - 1], nextRecordStart(guess, begin, end));
+    }
+    bounds[numChunks] = end;
+
+    vector<StreetGraphBuilder> parts(numChunks);
+    vector<char> ok(numChunks, false);
+    vector<thread> workers;
+    for (unsigned int i = 0; i < numChunks; i++) {
+        workers.push_back(thread([&, i]() {
+            ok[i] = parseMapText(bounds[i], bounds[i + 1], parts[i]);
+        }));
+    }
+    for (thread& t : workers)
+        t.join();
+
+    for (unsigned int i = 0; i < numChunks; i++) {
+        if (!ok[i])
+            return false;
+        builder.append(parts[i]);
+    }
+    return true;
 }
 
 class StreetMapImpl
@@ -18,78 +198,103 @@ class StreetMapImpl
 public:
     StreetMapImpl();
     ~StreetMapImpl();
-    bool load(string mapFile);
+    bool load(string mapFile, unsigned int numThreads);
+    bool saveSnapshot(string snapshotFile) const;
     bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    void buildContractionHierarchy();
+    void buildLandmarks(unsigned int count, LandmarkSelection selection);
+    const StreetGraph& getGraph() const { return graph; }
+    const ContractionHierarchy& getHierarchy() const { return hierarchy; }
+    const LandmarkTable& getLandmarks() const { return landmarkTable; }
+    void enableRouteCache(unsigned long long maxRoutes);
+    RouteCache* getRouteCache() const { return routeCache.get(); }
+    const SpatialIndex& getSpatialIndex() const { return spatialIndex; }
 private:
-	ExpandableHashMap<GeoCoord, vector<StreetSegment>>* streetMap;
+	StreetGraph graph;
+	  // routing data; empty unless built or found in a snapshot
+	ContractionHierarchy hierarchy;
+	LandmarkTable landmarkTable;
+	unique_ptr<RouteCache> routeCache; // routes found so far, if enabled
+	SpatialIndex spatialIndex;         // built with every load, from the graph either way
 };
 
 StreetMapImpl::StreetMapImpl() {
-	streetMap = new ExpandableHashMap<GeoCoord, vector<StreetSegment>>;
 }
 
 StreetMapImpl::~StreetMapImpl() {
-	
-	delete streetMap; // calls expandable hash map destructor, which frees memory
 }
 
-bool StreetMapImpl::load(string mapFile) {
-	ifstream mapdata(mapFile);
-	if (!mapdata) {
+bool StreetMapImpl::load(string mapFile, unsigned int numThreads) {
+	MappedFile mapdata;
+	if (!mapdata.open(mapFile)) {
 		std::cerr << "Unable to open " << mapFile << endl;
 		return false;
 	}
 
-	string startLat, startLong, endLat, endLong, streetname;
-	while (getline(mapdata, streetname)) {
-		int numSegs;
-		mapdata >> numSegs;
-		mapdata.ignore(10000, '\n');
-		for (int i = 0; i < numSegs; i++) {
-			// get all the latitudes and longitudes from a line
-			mapdata >> startLat;
-			mapdata.ignore(10000, ' ');
-			mapdata >> startLong;
-			mapdata.ignore(10000, ' ');
-			mapdata >> endLat;
-			mapdata.ignore(10000, ' ');
-			mapdata >> endLong;
-			mapdata.ignore(10000, '\n');
-			GeoCoord startCoord(startLat, startLong);
-			GeoCoord endCoord(endLat, endLong);
-			StreetSegment street(startCoord, endCoord, streetname); // create normal street
-			StreetSegment reverseStreet(endCoord, startCoord, streetname); // create reverse of street
-			
-			// add to reversed street vector
-			vector<StreetSegment>* endCoordVec = (*streetMap).find(endCoord);
-			if (endCoordVec == nullptr) {
-				endCoordVec = new vector<StreetSegment>;
-			}
-			(*endCoordVec).push_back(reverseStreet);
-			(*streetMap).associate(endCoord, *endCoordVec);
-
-			// add to normal street vector
-			vector<StreetSegment>* startCoordVec = (*streetMap).find(startCoord);
-			if (startCoordVec == nullptr) {
-				startCoordVec = new vector<StreetSegment>;
-			}
-			(*startCoordVec).push_back(street);
-			(*streetMap).associate(startCoord, *startCoordVec);
+	hierarchy.clear();
+	landmarkTable.clear();
+	spatialIndex.clear();
+	if (routeCache) {
+		routeCache->clear(); // its node ids belong to the old map
+	}
+	if (StreetGraph::isSnapshot(mapdata.data(), mapdata.size())) { // precompiled map: use it in place
+		mapdata.close();
+		if (!graph.loadSnapshot(mapFile)) {
+			return false;
 		}
+		hierarchy.attach(graph); // picks up routing data saved with the map, if there is any
+		landmarkTable.attach(graph);
+		spatialIndex.build(graph);
+		return true;
+	}
+
+	// small files aren't worth a thread each; give every thread at least a few MB
+	const size_t minChunkSize = 4 << 20;
+	if (numThreads == 0) {
+		numThreads = max(1u, thread::hardware_concurrency());
+	}
+	unsigned int numChunks = (unsigned int)min<size_t>(numThreads, max<size_t>(1, mapdata.size() / minChunkSize));
+
+	StreetGraphBuilder builder;
+	const char* begin = mapdata.data();
+	const char* end = begin + mapdata.size();
+	bool parsed = (numChunks > 1) ? parseMapTextParallel(begin, end, numChunks, builder)
+	                              : parseMapText(begin, end, builder);
+	if (!parsed) {
+		graph.clear();
+		return false;
 	}
-	mapdata.close();
+	builder.build(graph); // copies the text it needs, so the file can be unmapped afterwards
+	spatialIndex.build(graph);
 	return true;
 }
 
+bool StreetMapImpl::saveSnapshot(string snapshotFile) const {
+	vector<SnapshotSection> extra = hierarchy.snapshotSections();
+	vector<SnapshotSection> landmarkSections = landmarkTable.snapshotSections();
+	extra.insert(extra.end(), landmarkSections.begin(), landmarkSections.end());
+	return graph.saveSnapshot(snapshotFile, extra);
+}
+
+void StreetMapImpl::buildContractionHierarchy() {
+	hierarchy.build(graph);
+}
+
+void StreetMapImpl::buildLandmarks(unsigned int count, LandmarkSelection selection) {
+	landmarkTable.build(graph, count, selection);
+}
+
+void StreetMapImpl::enableRouteCache(unsigned long long maxRoutes) {
+	routeCache.reset(maxRoutes == 0 ? nullptr : new RouteCache(maxRoutes));
+}
+
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const {
 	segs.clear();
-	// find the vector containing segments starting with GeoCoord gc
-	const vector<StreetSegment>* vec = const_cast<vector<StreetSegment>*>((*streetMap).find(gc));
-	if (vec != nullptr) {
-		auto it = vec->begin();
-		while (it != vec->end()) {
-			segs.push_back(*it); // push all these segments into segs vector
-			it++;
+	// find the node at GeoCoord gc and copy out the segments leaving it
+	unsigned int node = graph.findNode(gc);
+	if (node != StreetGraph::NO_NODE) {
+		for (const StreetEdge& e : graph.edgesFrom(node)) {
+			segs.push_back(graph.segment(e));
 		}
 		return true;
 	}
@@ -113,10 +318,65 @@ StreetMap::~StreetMap()
 
 bool StreetMap::load(string mapFile)
 {
-    return m_impl->load(mapFile);
+    return m_impl->load(mapFile, 1);
+}
+
+bool StreetMap::load(string mapFile, unsigned int numThreads)
+{
+    return m_impl->load(mapFile, numThreads);
+}
+
+bool StreetMap::saveSnapshot(string snapshotFile) const
+{
+    return m_impl->saveSnapshot(snapshotFile);
+}
+
+void StreetMap::buildContractionHierarchy()
+{
+    m_impl->buildContractionHierarchy();
+}
+
+void StreetMap::buildLandmarks(unsigned int count, LandmarkSelection selection)
+{
+    m_impl->buildLandmarks(count, selection);
+}
+
+void StreetMap::enableRouteCache(unsigned long long maxRoutes)
+{
+    m_impl->enableRouteCache(maxRoutes);
 }
 
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
+
+const StreetGraph& StreetMap::graph() const
+{
+    return m_impl->getGraph();
+}
+
+EdgeRange StreetMap::edgesFrom(unsigned int node) const
+{
+    return m_impl->getGraph().edgesFrom(node);
+}
+
+const ContractionHierarchy& StreetMap::contractionHierarchy() const
+{
+    return m_impl->getHierarchy();
+}
+
+const LandmarkTable& StreetMap::landmarks() const
+{
+    return m_impl->getLandmarks();
+}
+
+RouteCache* StreetMap::routeCache() const
+{
+    return m_impl->getRouteCache();
+}
+
+const SpatialIndex& StreetMap::spatialIndex() const
+{
+    return m_impl->getSpatialIndex();
+}
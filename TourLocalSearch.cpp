@@ -0,0 +1,247 @@
+#include "TourLocalSearch.h"
+#include <vector>
+#include <deque>
+#include <algorithm>
+using namespace std;
+
+// moves must gain at least this much, so rounding can't make two moves undo each other forever
+static const double MIN_GAIN = 1e-10;
+
+// The longest run of stops an Or-opt move picks up
+static const unsigned int MAX_SEGMENT = 3;
+
+// A tour as a cycle of matrix points in an array, with each point's position,
+// so neighbours along the tour are O(1) and a 2-opt move is one reversal.
+class TourArray
+{
+public:
+	TourArray(const vector<unsigned int>& order)
+	{
+		m_tour.push_back(0);
+		m_tour.insert(m_tour.end(), order.begin(), order.end());
+		m_pos.resize(m_tour.size());
+		for (unsigned int i = 0; i < m_tour.size(); i++) {
+			m_pos[m_tour[i]] = i;
+		}
+	}
+
+	unsigned int size() const { return (unsigned int)m_tour.size(); }
+	unsigned int next(unsigned int p) const { return m_tour[(m_pos[p] + 1) % size()]; }
+	unsigned int prev(unsigned int p) const { return m_tour[(m_pos[p] + size() - 1) % size()]; }
+	  // true if p is one of the count points starting at first and going forward
+	bool within(unsigned int p, unsigned int first, unsigned int count) const
+	{
+		return (m_pos[p] + size() - m_pos[first]) % size() < count;
+	}
+
+	  // reverse the path that runs forward from 'from' to 'to'; reversing the rest
+	  // of the cycle instead gives the same tour, so do whichever is shorter
+	void reversePath(unsigned int from, unsigned int to)
+	{
+		unsigned int n = size();
+		unsigned int i = m_pos[from];
+		unsigned int j = m_pos[to];
+		unsigned int length = (j + n - i) % n + 1;
+		if (2 * length > n) {
+			i = (m_pos[to] + 1) % n;
+			j = (m_pos[from] + n - 1) % n;
+			length = n - length;
+		}
+		for (unsigned int k = 0; k < length / 2; k++) {
+			swap(m_tour[i], m_tour[j]);
+			m_pos[m_tour[i]] = i;
+			m_pos[m_tour[j]] = j;
+			i = (i + 1) % n;
+			j = (j + n - 1) % n;
+		}
+	}
+
+	  // Take the count points running forward from first out of the tour and put
+	  // them between the adjacent points c and d, with end (first or the last of
+	  // the run) next to c.
+	void moveSegment(unsigned int first, unsigned int count, unsigned int end, unsigned int c, unsigned int d)
+	{
+		unsigned int n = size();
+		vector<unsigned int> segment, rest;
+		for (unsigned int k = 0; k < count; k++) {
+			segment.push_back(m_tour[(m_pos[first] + k) % n]);
+		}
+		for (unsigned int k = count; k < n; k++) {
+			rest.push_back(m_tour[(m_pos[first] + k) % n]);
+		}
+		unsigned int ic = (unsigned int)(find(rest.begin(), rest.end(), c) - rest.begin());
+		unsigned int m = (unsigned int)rest.size();
+		bool dAfterC = rest[(ic + 1) % m] == d;
+		  // the run goes in after c (reading forward) or before it, with end touching c
+		if (dAfterC == (end != segment.front())) {
+			reverse(segment.begin(), segment.end());
+		}
+		unsigned int at = dAfterC ? ic + 1 : ic;
+		rest.insert(rest.begin() + at, segment.begin(), segment.end());
+		m_tour.swap(rest);
+		for (unsigned int i = 0; i < n; i++) {
+			m_pos[m_tour[i]] = i;
+		}
+	}
+
+	  // the stops in visiting order, starting after the depot
+	void extract(vector<unsigned int>& order) const
+	{
+		order.clear();
+		for (unsigned int k = 1; k < size(); k++) {
+			order.push_back(m_tour[(m_pos[0] + k) % size()]);
+		}
+	}
+
+private:
+	vector<unsigned int> m_tour;
+	vector<unsigned int> m_pos;
+};
+
+TourLocalSearch::TourLocalSearch(const DistanceMatrix& costs, unsigned int numNeighbors)
+ : m_costs(costs)
+{
+	unsigned int n = costs.size();
+	m_numNeighbors = (n == 0) ? 0 : min(numNeighbors, n - 1);
+	m_neighbors.resize((size_t)n * m_numNeighbors);
+	vector<unsigned int> others;
+	for (unsigned int p = 0; p < n; p++) {
+		others.clear();
+		for (unsigned int q = 0; q < n; q++) {
+			if (q != p) {
+				others.push_back(q);
+			}
+		}
+		partial_sort(others.begin(), others.begin() + m_numNeighbors, others.end(),
+			[&](unsigned int a, unsigned int b) {
+				return costs(p, a) < costs(p, b) || (costs(p, a) == costs(p, b) && a < b);
+			});
+		copy(others.begin(), others.begin() + m_numNeighbors, m_neighbors.begin() + (size_t)p * m_numNeighbors);
+	}
+}
+
+double TourLocalSearch::improve(vector<unsigned int>& order, SearchBudget* budget) const {
+	const DistanceMatrix& cost = m_costs;
+	TourArray tour(order);
+	unsigned int n = tour.size();
+
+	deque<unsigned int> active; // points whose don't-look bit is off
+	vector<char> queued(n, true);
+	for (unsigned int k = 0; k < n; k++) {
+		active.push_back(k == 0 ? 0 : order[k - 1]);
+	}
+	auto wake = [&](unsigned int p) {
+		if (!queued[p]) {
+			queued[p] = true;
+			active.push_back(p);
+		}
+	};
+
+	unsigned int uncharged = 0; // candidate moves scored since the budget was last charged
+	while (n >= 4 && !active.empty()) {
+		if (budget != nullptr && uncharged >= BUDGET_BATCH) {
+			bool spent = budget->charge(uncharged);
+			uncharged = 0;
+			if (spent) {
+				break; // the tour is whole between moves, so stop with what we have
+			}
+		}
+		unsigned int a = active.front();
+		active.pop_front();
+		queued[a] = false;
+		const unsigned int* nearest = &m_neighbors[(size_t)a * m_numNeighbors];
+		bool improved = false;
+
+		// 2-opt: drop (a, b) and (c, d), where b and d follow (or both precede) a and
+		// c, and add (a, c) and (b, d). Neighbours are sorted, so once (a, c) is no
+		// shorter than (a, b) no later c can gain.
+		for (int dir = 0; dir < 2 && !improved; dir++) {
+			unsigned int b = (dir == 0) ? tour.next(a) : tour.prev(a);
+			double ab = cost(a, b);
+			for (unsigned int k = 0; k < m_numNeighbors && !improved; k++) {
+				unsigned int c = nearest[k];
+				if (ab - cost(a, c) <= MIN_GAIN) {
+					break;
+				}
+				unsigned int d = (dir == 0) ? tour.next(c) : tour.prev(c);
+				if (c == b || d == a) {
+					continue;
+				}
+				uncharged++;
+				if (cost(a, c) + cost(b, d) - ab - cost(c, d) < -MIN_GAIN) {
+					if (dir == 0) {
+						tour.reversePath(b, c);
+					}
+					else {
+						tour.reversePath(a, d);
+					}
+					wake(b);
+					wake(c);
+					wake(d);
+					improved = true;
+				}
+			}
+		}
+
+		// Or-opt: lift the run of 1..3 points starting at a out from between p and
+		// q, and drop it between c and an adjacent d, one of its ends next to c.
+		for (unsigned int count = 1; count <= MAX_SEGMENT && count + 3 <= n && !improved; count++) {
+			unsigned int last = a;
+			for (unsigned int k = 1; k < count; k++) {
+				last = tour.next(last);
+			}
+			unsigned int p = tour.prev(a);
+			unsigned int q = tour.next(last);
+			double removeGain = cost(p, a) + cost(last, q) - cost(p, q);
+			if (removeGain <= MIN_GAIN) {
+				continue;
+			}
+			for (int side = 0; side < (count == 1 ? 1 : 2) && !improved; side++) {
+				unsigned int end = (side == 0) ? a : last;
+				unsigned int other = (side == 0) ? last : a;
+				const unsigned int* near = &m_neighbors[(size_t)end * m_numNeighbors];
+				for (unsigned int k = 0; k < m_numNeighbors && !improved; k++) {
+					unsigned int c = near[k];
+					if (cost(end, c) >= removeGain - MIN_GAIN) {
+						break;
+					}
+					if (tour.within(c, a, count)) {
+						continue;
+					}
+					unsigned int choices[2] = { tour.next(c), tour.prev(c) };
+					for (unsigned int d : choices) {
+						if (tour.within(d, a, count)) {
+							continue;
+						}
+						uncharged++;
+						if (cost(c, end) + cost(other, d) - cost(c, d) - removeGain < -MIN_GAIN) {
+							tour.moveSegment(a, count, end, c, d);
+							wake(p);
+							wake(q);
+							wake(last);
+							wake(c);
+							wake(d);
+							improved = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+		if (improved) {
+			wake(a);
+		}
+	}
+
+	if (budget != nullptr) {
+		budget->charge(uncharged);
+	}
+	tour.extract(order);
+	double length = 0;
+	unsigned int prev = 0;
+	for (unsigned int p : order) {
+		length += cost(prev, p);
+		prev = p;
+	}
+	return length + cost(prev, 0);
+}
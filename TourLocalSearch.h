@@ -0,0 +1,38 @@
+#ifndef TOURLOCALSEARCH_INCLUDED
+#define TOURLOCALSEARCH_INCLUDED
+
+#include "DistanceMatrix.h"
+#include "SearchBudget.h"
+#include <vector>
+
+// Deterministic local search for delivery tours: 2-opt (replace two edges by
+// reconnecting the tour the other way) and Or-opt (move a run of up to three
+// stops, either way round, next to one of its near neighbours), repeated until
+// no move shortens the tour.
+//
+// Moves are only tried toward each stop's k nearest neighbours, since an
+// improving move almost always adds a short edge, and a move's gain bound lets
+// the scan stop early. Don't-look bits keep a queue of stops worth looking at:
+// a stop with no improving move leaves it until a move changes one of its tour
+// edges. A pass therefore costs about O(n * k) evaluations instead of O(n^2).
+//
+// The depot is matrix point 0 and the tour is depot -> order... -> depot, as in
+// DeliveryOptimizer. Costs are assumed symmetric.
+class TourLocalSearch
+{
+public:
+	  // builds the candidate lists; costs must outlive this object
+	TourLocalSearch(const DistanceMatrix& costs, unsigned int numNeighbors);
+
+	  // improve order (matrix points 1..n) in place and return the tour's length;
+	  // safe to call from several threads at once. With a budget, stops between
+	  // moves once it is spent, leaving the best tour found so far.
+	double improve(std::vector<unsigned int>& order, SearchBudget* budget = nullptr) const;
+
+private:
+	const DistanceMatrix& m_costs;
+	unsigned int m_numNeighbors;
+	std::vector<unsigned int> m_neighbors; // m_numNeighbors nearest points of each point, nearest first
+};
+
+#endif // TOURLOCALSEARCH_INCLUDED
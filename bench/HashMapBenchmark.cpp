@@ -0,0 +1,144 @@
+// Compares ExpandableHashMap and OpenHashMap against std::unordered_map on the
+// key types the planner actually uses: dense node ids and packed CoordKeys.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -I. bench/HashMapBenchmark.cpp -o hashbench
+//   ./hashbench [numKeys]
+
+#include "ExpandableHashMap.h"
+#include "OpenHashMap.h"
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+using namespace std;
+
+typedef unsigned long long CoordKey; // same packing as StreetGraph.h
+
+  // std::unordered_map gets the same hash the custom maps use, so the table layout is what's compared
+template<typename KeyType>
+struct StdHash
+{
+	size_t operator()(const KeyType& key) const { return DefaultHash<KeyType>()(key); }
+};
+
+static double nanosPerOp(chrono::steady_clock::time_point start, size_t ops)
+{
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ops;
+}
+
+struct Result
+{
+	double insert;
+	double hit;
+	double miss;
+	unsigned long long checksum; // keeps the optimizer from dropping the lookups
+};
+
+template<typename Map, typename KeyType>
+static Result runMap(Map& m, const vector<KeyType>& keys, const vector<KeyType>& misses)
+{
+	Result r;
+	r.checksum = 0;
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < keys.size(); i++) {
+		m.associate(keys[i], (unsigned int)i);
+	}
+	r.insert = nanosPerOp(start, keys.size());
+
+	start = chrono::steady_clock::now();
+	for (const KeyType& k : keys) {
+		r.checksum += *m.find(k);
+	}
+	r.hit = nanosPerOp(start, keys.size());
+
+	start = chrono::steady_clock::now();
+	for (const KeyType& k : misses) {
+		r.checksum += (m.find(k) == nullptr);
+	}
+	r.miss = nanosPerOp(start, misses.size());
+	return r;
+}
+
+template<typename KeyType>
+static Result runStd(const vector<KeyType>& keys, const vector<KeyType>& misses)
+{
+	unordered_map<KeyType, unsigned int, StdHash<KeyType> > m;
+	Result r;
+	r.checksum = 0;
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < keys.size(); i++) {
+		m[keys[i]] = (unsigned int)i;
+	}
+	r.insert = nanosPerOp(start, keys.size());
+
+	start = chrono::steady_clock::now();
+	for (const KeyType& k : keys) {
+		r.checksum += m.find(k)->second;
+	}
+	r.hit = nanosPerOp(start, keys.size());
+
+	start = chrono::steady_clock::now();
+	for (const KeyType& k : misses) {
+		r.checksum += (m.find(k) == m.end());
+	}
+	r.miss = nanosPerOp(start, misses.size());
+	return r;
+}
+
+static void report(const string& name, const Result& r)
+{
+	cout << "  " << left << setw(28) << name << right << fixed << setprecision(1)
+	     << setw(10) << r.insert << setw(10) << r.hit << setw(10) << r.miss
+	     << "   (checksum " << r.checksum << ")" << endl;
+}
+
+template<typename KeyType>
+static void compare(const string& title, const vector<KeyType>& keys, const vector<KeyType>& misses)
+{
+	cout << title << " (" << keys.size() << " keys), ns per operation:" << endl;
+	cout << "  " << left << setw(28) << "" << right << setw(10) << "insert" << setw(10) << "hit" << setw(10) << "miss" << endl;
+	{
+		ExpandableHashMap<KeyType, unsigned int> m;
+		report("ExpandableHashMap", runMap(m, keys, misses));
+	}
+	{
+		OpenHashMap<KeyType, unsigned int> m;
+		report("OpenHashMap", runMap(m, keys, misses));
+	}
+	{
+		OpenHashMap<KeyType, unsigned int> m(0.75, true);
+		report("OpenHashMap (incremental)", runMap(m, keys, misses));
+	}
+	report("std::unordered_map", runStd(keys, misses));
+	cout << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1000000;
+	mt19937_64 rng(42);
+
+	  // node ids as the router sees them: dense, inserted in a scattered order
+	vector<unsigned int> ids(n), idMisses(n);
+	for (size_t i = 0; i < n; i++) {
+		ids[i] = (unsigned int)i;
+		idMisses[i] = (unsigned int)(n + i);
+	}
+	shuffle(ids.begin(), ids.end(), rng);
+	compare("Node ids", ids, idMisses);
+
+	  // coordinates around Westwood in 1e-7 degree units, packed like StreetGraph's CoordKey
+	vector<CoordKey> coords(n), coordMisses(n);
+	uniform_int_distribution<int> lat(339000000, 342000000), lon(-1186000000, -1182000000);
+	for (size_t i = 0; i < n; i++) {
+		coords[i] = ((CoordKey)(unsigned int)lat(rng) << 32) | (unsigned int)lon(rng);
+		coordMisses[i] = ((CoordKey)(unsigned int)(lat(rng) + 400000000) << 32) | (unsigned int)lon(rng);
+	}
+	compare("Packed coordinates", coords, coordMisses);
+}
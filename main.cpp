@@ -1,32 +1,95 @@
 #include "provided.h"
 #include "ExpandableHashMap.h"
+#include "PlanningServer.h"
+#include "RouteCache.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#if defined(_WIN32)
+#define NOMINMAX // keep windows.h from defining min and max macros
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 using namespace std;
 
-bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v);
-bool parseDelivery(string line, string& lat, string& lon, string& item);
+bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v, ostream& diagnostics);
+bool parseDelivery(const string& line, string& lat, string& lon, string& item, ostream& diagnostics);
+bool writeDeliveryPlan(const DeliveryPlanner& dp, const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, ostream& out);
+int runBatch(int argc, char *argv[]);
+int runServer(int argc, char *argv[]);
 
 int main(int argc, char *argv[])
 {
+    if (argc >= 4 && string(argv[1]) == "-snapshot")
+    {
+          // precompile a text map so later runs can load it instantly,
+          // optionally with routing data: a contraction hierarchy and/or landmarks
+        bool withHierarchy = false;
+        unsigned int numLandmarks = 0;
+        int arg = 2;
+        for (; arg < argc - 2; arg++)
+        {
+            if (string(argv[arg]) == "-ch")
+                withHierarchy = true;
+            else if (string(argv[arg]) == "-landmarks" && arg + 1 < argc - 2)
+                numLandmarks = (unsigned int)atoi(argv[++arg]);
+            else
+                break;
+        }
+        if (arg != argc - 2)
+        {
+            cout << "Usage: " << argv[0] << " -snapshot [-ch] [-landmarks count] mapdata.txt mapdata.snapshot" << endl;
+            return 1;
+        }
+        string mapFile = argv[argc - 2];
+        string snapshotFile = argv[argc - 1];
+        StreetMap sm;
+        if (!sm.load(mapFile, 0))
+        {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        if (withHierarchy)
+            sm.buildContractionHierarchy();
+        if (numLandmarks > 0)
+            sm.buildLandmarks(numLandmarks);
+        if (!sm.saveSnapshot(snapshotFile))
+        {
+            cout << "Unable to write map snapshot " << snapshotFile << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "-batch")
+        return runBatch(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "-serve")
+        return runServer(argc, argv);
     if (argc != 3)
     {
         cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt" << endl;
+        cout << "       " << argv[0] << " -snapshot [-ch] [-landmarks count] mapdata.txt mapdata.snapshot" << endl;
+        cout << "       " << argv[0] << " -batch [-threads count] [-cache routes] [-snap miles] [-out directory] mapdata.txt manifest|directory|@list..." << endl;
+        cout << "       " << argv[0] << " -serve [-threads count] [-queue count] [-cache routes] [-snap miles] [-socket path] mapdata.txt" << endl;
         return 1;
     }
     StreetMap sm;
         
-    if (!sm.load(argv[1]))
+    if (!sm.load(argv[1], 0))
     {
         cout << "Unable to load map data file " << argv[1] << endl;
         return 1;
     }
     GeoCoord depot;
     vector<DeliveryRequest> deliveries;
-    if (!loadDeliveryRequests(argv[2], depot, deliveries))
+    if (!loadDeliveryRequests(argv[2], depot, deliveries, cout))
     {
         cout << "Unable to load delivery request file " << argv[2] << endl;
         return 1;
@@ -34,29 +97,277 @@ int main(int argc, char *argv[])
     cout << "Generating route...\n\n";
 
     DeliveryPlanner dp(&sm);
+    return writeDeliveryPlan(dp, depot, deliveries, cout) ? 0 : 1;
+}
+
+  // plan one manifest and write the directions (or why there are none) to out
+bool writeDeliveryPlan(const DeliveryPlanner& dp, const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, ostream& out)
+{
     vector<DeliveryCommand> dcs;
     double totalMiles;
     DeliveryResult result = dp.generateDeliveryPlan(depot, deliveries, dcs, totalMiles);
     if (result == BAD_COORD)
     {
-        cout << "One or more depot or delivery coordinates are invalid." << endl;
-        return 1;
+        out << "One or more depot or delivery coordinates are invalid." << endl;
+        return false;
     }
     if (result == NO_ROUTE)
     {
-        cout << "No route can be found to deliver all items." << endl;
-        return 1;
+        out << "No route can be found to deliver all items." << endl;
+        return false;
     }
-    cout << "Starting at the depot...\n";
+    out << "Starting at the depot...\n";
     for (const auto& dc : dcs)
-        cout << dc.description() << endl;
-    cout << "You are back at the depot and your deliveries are done!\n";
-    cout.setf(ios::fixed);
-    cout.precision(2);
-    cout << totalMiles << " miles travelled for all deliveries." << endl;
+        out << dc.description() << endl;
+    out << "You are back at the depot and your deliveries are done!\n";
+    out.setf(ios::fixed);
+    out.precision(2);
+    out << totalMiles << " miles travelled for all deliveries." << endl;
+    return true;
+}
+
+  // whether a directory entry is a plan written by an earlier batch run
+bool isPlanFile(const string& name)
+{
+    return name.size() >= 5 && name.compare(name.size() - 5, 5, ".plan") == 0;
+}
+
+  // add the regular files in directory to files, in name order, leaving out the
+  // .plan files batch mode writes next to manifests; false if it isn't a directory
+bool listDirectory(const string& directory, vector<string>& files)
+{
+    vector<string> names;
+#if defined(_WIN32)
+    WIN32_FIND_DATAA found;
+    HANDLE h = FindFirstFileA((directory + "\\*").c_str(), &found);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    do
+    {
+        if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !isPlanFile(found.cFileName))
+            names.push_back(directory + "\\" + found.cFileName);
+    } while (FindNextFileA(h, &found));
+    FindClose(h);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr)
+        return false;
+    while (dirent* entry = readdir(dir))
+    {
+        string path = directory + "/" + entry->d_name;
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode) && !isPlanFile(path))
+            names.push_back(path);
+    }
+    closedir(dir);
+#endif
+    sort(names.begin(), names.end());
+    files.insert(files.end(), names.begin(), names.end());
+    return true;
 }
 
-bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v)
+  // A manifest's output file: its name plus ".plan", in outDirectory if one was given
+string planFileName(const string& manifest, const string& outDirectory)
+{
+    if (outDirectory.empty())
+        return manifest + ".plan";
+    size_t slash = manifest.find_last_of("/\\");
+    string name = (slash == string::npos) ? manifest : manifest.substr(slash + 1);
+    return outDirectory + "/" + name + ".plan";
+}
+
+  // Batch mode: load the map once and plan many manifests against it. Each
+  // argument after the map is a manifest, a directory of manifests, or @file
+  // listing manifests one per line. Manifests are handed out one at a time to
+  // a pool of threads, largest first, so a few big ones can't leave the other
+  // threads idle at the end; each plan goes to its own .plan file and a summary
+  // line per manifest, followed by any complaints about its lines, is printed in
+  // the order given once all are done.
+int runBatch(int argc, char *argv[])
+{
+    unsigned int numThreads = 0;
+    unsigned long long cacheRoutes = 0;
+    double maxSnapMiles = DEFAULT_MAX_SNAP_MILES;
+    string outDirectory;
+    int arg = 2;
+    for (; arg < argc - 2; arg++)
+    {
+        if (string(argv[arg]) == "-threads")
+            numThreads = (unsigned int)atoi(argv[++arg]);
+        else if (string(argv[arg]) == "-cache")
+            cacheRoutes = strtoull(argv[++arg], nullptr, 10);
+        else if (string(argv[arg]) == "-out")
+            outDirectory = argv[++arg];
+        else if (string(argv[arg]) == "-snap")
+            maxSnapMiles = atof(argv[++arg]);
+        else
+            break;
+    }
+    if (arg > argc - 2)
+    {
+        cout << "Usage: " << argv[0] << " -batch [-threads count] [-cache routes] [-snap miles] [-out directory] mapdata.txt manifest|directory|@list..." << endl;
+        return 1;
+    }
+    string mapFile = argv[arg++];
+    vector<string> manifests;
+    for (; arg < argc; arg++)
+    {
+        string name = argv[arg];
+        if (name.size() > 1 && name[0] == '@')
+        {
+            ifstream list(name.substr(1));
+            if (!list)
+            {
+                cout << "Unable to read manifest list " << name.substr(1) << endl;
+                return 1;
+            }
+            string line;
+            while (getline(list, line))
+            {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (!line.empty())
+                    manifests.push_back(line);
+            }
+        }
+        else if (!listDirectory(name, manifests))
+            manifests.push_back(name);
+    }
+
+    StreetMap sm;
+    if (!sm.load(mapFile, 0))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return 1;
+    }
+    sm.enableRouteCache(cacheRoutes);
+
+    // biggest manifests first; the shared counter then balances what's left
+    vector<pair<streamoff, unsigned int> > bySize;
+    for (unsigned int i = 0; i < manifests.size(); i++)
+    {
+        ifstream f(manifests[i], ios::binary | ios::ate);
+        bySize.push_back(make_pair(f ? -(streamoff)f.tellg() : 0, i));
+    }
+    sort(bySize.begin(), bySize.end());
+
+    DeliveryPlanner dp(&sm);
+    vector<string> summaries(manifests.size());
+    vector<string> diagnostics(manifests.size()); // kept per manifest so threads' messages don't interleave
+    atomic<unsigned int> next(0);
+    atomic<unsigned int> numFailed(0);
+    auto work = [&]() {
+        for (unsigned int k = next++; k < bySize.size(); k = next++)
+        {
+            unsigned int i = bySize[k].second;
+            string planFile = planFileName(manifests[i], outDirectory);
+            GeoCoord depot;
+            vector<DeliveryRequest> deliveries;
+            bool ok = false;
+            ostringstream messages;
+            if (!loadDeliveryRequests(manifests[i], depot, deliveries, messages))
+                summaries[i] = manifests[i] + ": unable to load delivery request file";
+            else
+            {
+                ofstream out(planFile);
+                if (!out)
+                    summaries[i] = manifests[i] + ": unable to write " + planFile;
+                else
+                {
+                    ok = writeDeliveryPlan(dp, depot, deliveries, out);
+                    summaries[i] = manifests[i] + (ok ? " -> " : ": failed, see ") + planFile;
+                }
+            }
+            diagnostics[i] = messages.str();
+            if (!ok)
+                numFailed++;
+        }
+    };
+    if (numThreads == 0)
+        numThreads = max(1u, thread::hardware_concurrency());
+    numThreads = max(1u, min(numThreads, (unsigned int)manifests.size()));
+      // the manifests already keep the cores busy, so each plan gets its share of
+      // them rather than starting a pool per core of its own
+    OptimizerOptions options;
+    options.numThreads = max(1u, thread::hardware_concurrency() / numThreads);
+    dp.setOptimizerOptions(options);
+    dp.setMaxSnapMiles(maxSnapMiles);
+    if (numThreads == 1)
+        work();
+    else
+    {
+        vector<thread> workers;
+        for (unsigned int i = 0; i < numThreads; i++)
+            workers.push_back(thread(work));
+        for (thread& t : workers)
+            t.join();
+    }
+
+    for (unsigned int i = 0; i < manifests.size(); i++)
+        cout << summaries[i] << endl << diagnostics[i];
+    cout << manifests.size() - numFailed << " of " << manifests.size() << " manifests planned." << endl;
+    if (sm.routeCache() != nullptr)
+    {
+        RouteCacheStats stats = sm.routeCache()->stats();
+        cout << "Route cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+             << stats.entries << " routes held." << endl;
+    }
+    return numFailed == 0 ? 0 : 1;
+}
+
+  // Server mode: load the map once, then answer JSON-line planning requests (see
+  // PlanningServer.h) from stdin on stdout, or from clients of a Unix domain
+  // socket. Messages go to stderr so stdout carries only results.
+int runServer(int argc, char *argv[])
+{
+    unsigned int numThreads = 0;
+    unsigned int queueCapacity = 64;
+    unsigned long long cacheRoutes = 0;
+    double maxSnapMiles = DEFAULT_MAX_SNAP_MILES;
+    string socketPath;
+    int arg = 2;
+    for (; arg < argc - 1; arg++)
+    {
+        if (string(argv[arg]) == "-threads")
+            numThreads = (unsigned int)atoi(argv[++arg]);
+        else if (string(argv[arg]) == "-queue")
+            queueCapacity = (unsigned int)atoi(argv[++arg]);
+        else if (string(argv[arg]) == "-socket")
+            socketPath = argv[++arg];
+        else if (string(argv[arg]) == "-cache")
+            cacheRoutes = strtoull(argv[++arg], nullptr, 10);
+        else if (string(argv[arg]) == "-snap")
+            maxSnapMiles = atof(argv[++arg]);
+        else
+            break;
+    }
+    if (arg != argc - 1)
+    {
+        cerr << "Usage: " << argv[0] << " -serve [-threads count] [-queue count] [-cache routes] [-snap miles] [-socket path] mapdata.txt" << endl;
+        return 1;
+    }
+    StreetMap sm;
+    if (!sm.load(argv[arg], 0))
+    {
+        cerr << "Unable to load map data file " << argv[arg] << endl;
+        return 1;
+    }
+    sm.enableRouteCache(cacheRoutes);
+    PlanningServer server(&sm, numThreads, queueCapacity, maxSnapMiles);
+    if (socketPath.empty())
+    {
+        cerr << "Ready for requests on standard input" << endl;
+        server.serveStream(cin, cout);
+        return 0;
+    }
+    cerr << "Ready for requests on " << socketPath << endl;
+    return server.serveSocket(socketPath) ? 0 : 1;
+}
+
+  // Read a manifest: the depot's coordinates, then one delivery per line. Lines
+  // that can't be used are reported to diagnostics and skipped; a missing file or
+  // an unreadable depot makes the whole manifest unusable.
+bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v, ostream& diagnostics)
 {
     ifstream inf(deliveriesFile);
     if (!inf)
@@ -65,35 +376,40 @@ bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<Deliver
     string lon;
     inf >> lat >> lon;
     inf.ignore(10000, '\n');
+    if (!isCoordText(lat) || !isCoordText(lon))
+    {
+        diagnostics << "Bad depot coordinates in deliveries file: " << lat << " " << lon << endl;
+        return false;
+    }
     depot = GeoCoord(lat, lon);
     string line;
     while (getline(inf, line))
     {
         string item;
-        if (parseDelivery(line, lat, lon, item))
+        if (parseDelivery(line, lat, lon, item, diagnostics))
             v.push_back(DeliveryRequest(item, GeoCoord(lat, lon)));
     }
     return true;
 }
 
-bool parseDelivery(string line, string& lat, string& lon, string& item)
+bool parseDelivery(const string& line, string& lat, string& lon, string& item, ostream& diagnostics)
 {
     const size_t colon = line.find(':');
     if (colon == string::npos)
     {
-        cout << "Missing colon in deliveries file line: " << line << endl;
+        diagnostics << "Missing colon in deliveries file line: " << line << endl;
         return false;
     }
     istringstream iss(line.substr(0, colon));
-    if (!(iss >> lat >> lon))
+    if (!(iss >> lat >> lon) || !isCoordText(lat) || !isCoordText(lon))
     {
-        cout << "Bad format in deliveries file line: " << line << endl;
+        diagnostics << "Bad format in deliveries file line: " << line << endl;
         return false;
     }
     item = line.substr(colon + 1);
     if (item.empty())
     {
-        cout << "Missing item in deliveries file line: " << line << endl;
+        diagnostics << "Missing item in deliveries file line: " << line << endl;
         return false;
     }
     return true;
@@ -8,6 +8,10 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <cctype>
 
 enum DeliveryResult
 {
@@ -30,6 +34,19 @@ struct GeoCoord
     double      longitude;
 };
 
+  // Whether text is a whole, finite decimal number, so a GeoCoord can be built
+  // from it without throwing; check untrusted text (manifests, requests) first
+inline
+bool isCoordText(const std::string& text)
+{
+    if (text.empty()  ||  std::isspace((unsigned char)text[0]))
+        return false;
+    char* end;
+    errno = 0;
+    double value = std::strtod(text.c_str(), &end);
+    return *end == '\0'  &&  errno != ERANGE  &&  std::isfinite(value);
+}
+
 inline
 bool operator==(const GeoCoord& lhs, const GeoCoord& rhs)
 {
@@ -72,14 +89,44 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
 }
 
 class StreetMapImpl;
+class StreetGraph;
+struct EdgeRange;
+class ContractionHierarchy;
+class LandmarkTable;
+class RouteCache;
+class SpatialIndex;
+
+  // How StreetMap::buildLandmarks places its landmarks
+enum LandmarkSelection
+{
+    LANDMARKS_FARTHEST,  // each one as far as possible from those already chosen
+    LANDMARKS_AVOID      // toward the nodes the current landmarks bound worst
+};
 
 class StreetMap
 {
 public:
     StreetMap();
     ~StreetMap();
-    bool load(std::string mapFile);
+    bool load(std::string mapFile);  // accepts a text map or a snapshot
+      // parse a large text map on numThreads threads (0 means one per core)
+    bool load(std::string mapFile, unsigned int numThreads);
+    bool saveSnapshot(std::string snapshotFile) const;  // includes the hierarchy and landmarks, if built
+      // preprocess the loaded map for ROUTE_CONTRACTION_HIERARCHY queries
+    void buildContractionHierarchy();
+      // precompute distances to count landmarks for ROUTE_ALT queries
+    void buildLandmarks(unsigned int count, LandmarkSelection selection = LANDMARKS_AVOID);
+      // keep up to maxRoutes routes found on this map for the router and distance
+      // matrices to reuse (see RouteCache.h); 0 turns the cache off
+    void enableRouteCache(unsigned long long maxRoutes);
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // Read-only, allocation-free access to the loaded graph (see StreetGraph.h)
+    const StreetGraph& graph() const;
+    EdgeRange edgesFrom(unsigned int node) const;
+    const ContractionHierarchy& contractionHierarchy() const;  // empty if never built
+    const LandmarkTable& landmarks() const;                    // empty if never built
+    RouteCache* routeCache() const;                            // nullptr unless enabled
+    const SpatialIndex& spatialIndex() const;                  // nearest node/segment queries
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -88,17 +135,44 @@ private:
 };
 
 class PointToPointRouterImpl;
+class SearchWorkspace;
+
+  // How PointToPointRouter searches; every algorithm returns a shortest route
+enum RouteAlgorithm
+{
+    ROUTE_ASTAR,                // forward A* toward the end
+    ROUTE_BIDIRECTIONAL_ASTAR,  // A* from both ends, meeting in the middle
+    ROUTE_ALT,                  // A* bounded by the map's landmarks; plain A* if it has none
+    ROUTE_CONTRACTION_HIERARCHY // upward searches over the map's hierarchy; ROUTE_ALT if it has none
+};
 
 class PointToPointRouter
 {
 public:
     PointToPointRouter(const StreetMap* sm);
     ~PointToPointRouter();
+      // uses the map's contraction hierarchy or landmarks when it has them, A* otherwise
     DeliveryResult generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+      // Same, but searching with the caller's workspace (see SearchWorkspace.h)
+      // and, if given, algorithm. Without one, the router lends each concurrent
+      // query a pooled workspace, so a single router can be queried from many threads.
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace,
+        RouteAlgorithm algorithm = ROUTE_CONTRACTION_HIERARCHY) const;
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteAlgorithm algorithm) const;
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -116,6 +190,58 @@ struct DeliveryRequest
 };
 
 class DeliveryOptimizerImpl;
+class DistanceMatrix;
+
+enum OptimizerMethod
+{
+    OPTIMIZE_ANNEAL,                  // simulated annealing only
+    OPTIMIZE_LOCAL_SEARCH,            // 2-opt / Or-opt from the given order (see TourLocalSearch.h)
+    OPTIMIZE_ANNEAL_THEN_LOCAL_SEARCH // polish each annealing chain's tour with local search
+};
+
+  // How DeliveryOptimizer searches. The annealing defaults are the original
+  // schedule; several chains, each started from the same order with its own seed,
+  // run on a pool of threads and the shortest tour wins. The result depends only
+  // on the seed and the number of chains, never on thread timing.
+struct OptimizerOptions
+{
+    OptimizerOptions()
+     : method(OPTIMIZE_ANNEAL_THEN_LOCAL_SEARCH), startTemperature(0.5), cooling(0.9), rounds(25),
+       movesPerStop(100), changesPerRound(10), numChains(4), numThreads(0), seed(1), numNeighbors(8),
+       exactStops(12), largeStops(5000), clusterSize(200), timeLimit(0), maxEvaluations(0)
+    {}
+    OptimizerMethod method;
+    double startTemperature;      // temperature of the first round
+    double cooling;               // temperature multiplier after each round
+    unsigned int rounds;          // most rounds per chain; a round with no accepted move ends it early
+    unsigned int movesPerStop;    // a round tries up to this many moves per stop...
+    unsigned int changesPerRound; // ...or stops once more than this many are accepted
+    unsigned int numChains;       // independent annealing chains (at least one); a fixed count, so the
+                                  // result is the same however many threads run them
+    unsigned int numThreads;      // threads one plan may use, for the chains and for DeliveryPlanner's
+                                  // snapping, distance matrix and leg routing; 0 means one per core
+    unsigned long long seed;      // chain i draws from a generator seeded with seed + i
+    unsigned int numNeighbors;    // local search only tries moves toward this many nearest stops
+    unsigned int exactStops;      // up to this many stops (at most 20), solve exactly instead
+    unsigned int largeStops;      // over this many, split the tour into clusters (see LargeTour.h)...
+    unsigned int clusterSize;     // ...of about this many stops each
+    double timeLimit;             // stop searching this many seconds after the call (cost matrices and
+                                  // neighbour lists are still built in full first); 0 means no deadline
+    unsigned long long maxEvaluations; // stop after scoring this many candidate tours; 0 means no limit
+};
+
+  // What the last optimizeDeliveryOrder call spent. With a deadline or an
+  // evaluation limit the search is anytime: when either runs out it stops and
+  // keeps the best order found so far (never worse than the order it was given).
+struct OptimizerStats
+{
+    OptimizerStats()
+     : seconds(0), evaluations(0), stoppedEarly(false)
+    {}
+    double seconds;                // wall-clock time spent
+    unsigned long long evaluations; // candidate tours (or moves) scored
+    bool stoppedEarly;             // the deadline or evaluation limit cut the search short
+};
 
 class DeliveryOptimizer
 {
@@ -127,6 +253,16 @@ public:
         std::vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+      // Same, but scoring tours by the distances in costs, where point 0 is the
+      // depot and point i + 1 is deliveries[i] (see DistanceMatrix.h)
+    void optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        std::vector<DeliveryRequest>& deliveries,
+        const DistanceMatrix& costs,
+        double& oldDistance,
+        double& newDistance) const;
+    void setOptions(const OptimizerOptions& options);
+    OptimizerStats lastStats() const;
       // We prevent a DeliveryOptimizer object from being copied or assigned.
     DeliveryOptimizer(const DeliveryOptimizer&) = delete;
     DeliveryOptimizer& operator=(const DeliveryOptimizer&) = delete;
@@ -176,6 +312,12 @@ public:
         return m_streetName;
     }
 
+      // the item a Deliver command delivers; empty for other commands
+    std::string item() const
+    {
+        return m_item;
+    }
+
     std::string description() const
     {
         std::ostringstream oss;
@@ -210,6 +352,9 @@ private:
 
 class DeliveryPlannerImpl;
 
+  // how far DeliveryPlanner moves an address to reach an intersection by default
+const double DEFAULT_MAX_SNAP_MILES = 0.25;
+
 class DeliveryPlanner
 {
 public:
@@ -220,6 +365,12 @@ public:
         const std::vector<DeliveryRequest>& deliveries,
         std::vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+      // how the stops are ordered (see OptimizerOptions)
+    void setOptimizerOptions(const OptimizerOptions& options);
+      // A depot or delivery that isn't at an intersection is moved to the nearest
+      // one if it is within miles, and is BAD_COORD otherwise; 0 accepts only
+      // exact intersections.
+    void setMaxSnapMiles(double miles);
       // We prevent a DeliveryPlanner object from being copied or assigned.
     DeliveryPlanner(const DeliveryPlanner&) = delete;
     DeliveryPlanner& operator=(const DeliveryPlanner&) = delete;
@@ -0,0 +1,99 @@
+// Checks solveExactTour against brute force: on 200 small random instances,
+// symmetric and not, the tour it returns must be a permutation of the stops, its
+// reported length must be the tour's actual length, and no ordering of the stops
+// may be shorter. Also checks that an exhausted budget leaves the order alone.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -pthread -I. tests/HeldKarpCheck.cpp $(ls *.cpp | grep -v main.cpp) -o heldkarpcheck
+//   ./heldkarpcheck
+
+#include "HeldKarp.h"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+static double tourLength(const vector<unsigned int>& order, const DistanceMatrix& costs)
+{
+	double length = 0;
+	unsigned int at = 0;
+	for (unsigned int stop : order) {
+		length += costs(at, stop);
+		at = stop;
+	}
+	return length + costs(at, 0);
+}
+
+int main()
+{
+	const unsigned int NUM_INSTANCES = 200;
+	mt19937 random(2024);
+	uniform_real_distribution<double> coordinate(0, 10);
+	uniform_real_distribution<double> detour(1, 1.5);
+	unsigned int failures = 0;
+
+	for (unsigned int t = 0; t < NUM_INSTANCES; t++) {
+		unsigned int n = 1 + t % 9; // stops, besides the depot
+		bool symmetric = (t % 2 == 0);
+		vector<double> x(n + 1), y(n + 1), stretch((n + 1) * (n + 1));
+		for (unsigned int i = 0; i <= n; i++) {
+			x[i] = coordinate(random);
+			y[i] = coordinate(random);
+		}
+		for (double& s : stretch) {
+			s = symmetric ? 1 : detour(random); // one-way streets make some trips longer one way
+		}
+		DistanceMatrix costs;
+		costs.computeWith(n + 1, [&](unsigned int i, unsigned int j) {
+			return hypot(x[i] - x[j], y[i] - y[j]) * stretch[i * (n + 1) + j];
+		});
+
+		vector<unsigned int> order;
+		for (unsigned int i = 1; i <= n; i++) {
+			order.push_back(i);
+		}
+		vector<unsigned int> permutation = order;
+		double bruteForce = numeric_limits<double>::infinity();
+		do {
+			bruteForce = min(bruteForce, tourLength(permutation, costs));
+		} while (next_permutation(permutation.begin(), permutation.end()));
+
+		double exact = solveExactTour(order, costs);
+		vector<unsigned int> sorted = order;
+		sort(sorted.begin(), sorted.end());
+		bool isPermutation = (sorted == permutation); // next_permutation ends back in sorted order
+		if (!isPermutation || fabs(exact - tourLength(order, costs)) > 1e-9 || fabs(exact - bruteForce) > 1e-9) {
+			cout << "FAIL: instance " << t << " (" << n << " stops): Held-Karp " << exact
+			     << ", brute force " << bruteForce << endl;
+			failures++;
+		}
+	}
+
+	// a budget that runs out before the tables are done leaves the order as it was
+	{
+		unsigned int n = 14;
+		DistanceMatrix costs;
+		costs.computeWith(n + 1, [](unsigned int i, unsigned int j) { return fabs((double)i - j) + (i + j) % 3; });
+		vector<unsigned int> order;
+		for (unsigned int i = n; i >= 1; i--) {
+			order.push_back(i);
+		}
+		vector<unsigned int> given = order;
+		SearchBudget budget(0, 1000);
+		double length = solveExactTour(order, costs, &budget);
+		if (order != given || fabs(length - tourLength(given, costs)) > 1e-9 || !budget.exhausted()) {
+			cout << "FAIL: an exhausted budget changed the order" << endl;
+			failures++;
+		}
+	}
+
+	if (failures != 0) {
+		cout << failures << " check(s) failed" << endl;
+		return 1;
+	}
+	cout << "All " << NUM_INSTANCES << " Held-Karp instances match brute force" << endl;
+	return 0;
+}
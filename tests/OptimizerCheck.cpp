@@ -0,0 +1,121 @@
+// Checks that the optimizer's answer doesn't depend on how many threads run its
+// chains: on random 60-stop tours, with and without an evaluation limit, one
+// thread and several must return the same order of the same length. Chains
+// charge their evaluations in batches, so it also checks directly that a batch
+// bigger than what is left of a chain's share can't run out the budget that the
+// other chains share.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -pthread -I. tests/OptimizerCheck.cpp $(ls *.cpp | grep -v main.cpp) -o optimizercheck
+//   ./optimizercheck
+
+#include "provided.h"
+#include "DistanceMatrix.h"
+#include "SearchBudget.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <random>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+  // the order the optimizer gives deliveries, as their item names
+static vector<string> optimize(const vector<DeliveryRequest>& deliveries, const DistanceMatrix& costs,
+                               const OptimizerOptions& options, double& newDistance)
+{
+	DeliveryOptimizer optimizer(nullptr);
+	optimizer.setOptions(options);
+	vector<DeliveryRequest> ordered = deliveries;
+	double oldDistance;
+	optimizer.optimizeDeliveryOrder(GeoCoord(), ordered, costs, oldDistance, newDistance);
+	vector<string> items;
+	for (const DeliveryRequest& d : ordered) {
+		items.push_back(d.item);
+	}
+	return items;
+}
+
+  // eight shares of a 1500-evaluation budget, split the way the optimizer splits it:
+  // seven chains each charging a full batch must leave the eighth untouched
+static bool sharesStayApart()
+{
+	const unsigned int NUM_CHAINS = 8;
+	const unsigned long long LIMIT = 1500;
+	SearchBudget budget(0, LIMIT);
+	vector<unique_ptr<SearchBudget> > shares;
+	for (unsigned int c = 0; c < NUM_CHAINS; c++) {
+		shares.emplace_back(new SearchBudget(budget, LIMIT / NUM_CHAINS + (c < LIMIT % NUM_CHAINS ? 1 : 0)));
+	}
+	for (unsigned int c = 0; c + 1 < NUM_CHAINS; c++) {
+		if (!shares[c]->charge(BUDGET_BATCH)) {
+			return false; // a batch is bigger than a share
+		}
+	}
+	if (shares[NUM_CHAINS - 1]->exhausted() || budget.used() != LIMIT - shares[NUM_CHAINS - 1]->limit()) {
+		return false;
+	}
+	return shares[NUM_CHAINS - 1]->charge(BUDGET_BATCH) && budget.exhausted() && budget.used() == LIMIT;
+}
+
+int main()
+{
+	const unsigned int NUM_STOPS = 60;
+	const OptimizerMethod methods[] = { OPTIMIZE_ANNEAL, OPTIMIZE_ANNEAL_THEN_LOCAL_SEARCH };
+	const unsigned long long limits[] = { 0, 5, 1500, 20000 };
+	const unsigned int threadCounts[] = { 2, 3, 8 };
+	unsigned int failures = 0;
+	unsigned int runs = 0;
+
+	if (!sharesStayApart()) {
+		cout << "FAIL: chains charging whole batches used up another chain's share" << endl;
+		failures++;
+	}
+
+	for (unsigned int seed = 1; seed <= 4; seed++) {
+		mt19937 random(seed);
+		uniform_real_distribution<double> coordinate(0, 10);
+		vector<double> x(NUM_STOPS + 1), y(NUM_STOPS + 1);
+		vector<DeliveryRequest> deliveries;
+		for (unsigned int i = 0; i <= NUM_STOPS; i++) {
+			x[i] = coordinate(random);
+			y[i] = coordinate(random);
+			if (i > 0) {
+				deliveries.push_back(DeliveryRequest("stop " + to_string(i), GeoCoord()));
+			}
+		}
+		DistanceMatrix costs;
+		costs.computeWith(NUM_STOPS + 1, [&](unsigned int i, unsigned int j) { return hypot(x[i] - x[j], y[i] - y[j]); });
+
+		for (OptimizerMethod method : methods) {
+			for (unsigned long long limit : limits) {
+				OptimizerOptions options;
+				options.method = method;
+				options.numChains = 8;
+				options.seed = seed;
+				options.maxEvaluations = limit;
+				options.numThreads = 1;
+				double expectedDistance;
+				vector<string> expected = optimize(deliveries, costs, options, expectedDistance);
+				for (unsigned int numThreads : threadCounts) {
+					options.numThreads = numThreads;
+					double distance;
+					vector<string> order = optimize(deliveries, costs, options, distance);
+					runs++;
+					if (order != expected || fabs(distance - expectedDistance) > 1e-9) {
+						cout << "FAIL: seed " << seed << ", method " << method << ", limit " << limit << ": "
+						     << numThreads << " threads found " << distance << " where one found " << expectedDistance << endl;
+						failures++;
+					}
+				}
+			}
+		}
+	}
+
+	if (failures != 0) {
+		cout << failures << " check(s) failed" << endl;
+		return 1;
+	}
+	cout << "All " << runs << " multi-threaded runs match the single-threaded ones" << endl;
+	return 0;
+}
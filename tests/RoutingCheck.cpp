@@ -0,0 +1,184 @@
+// Regression checks for the routing algorithms and the map loader:
+//  - bidirectional A*, ALT and the contraction hierarchy find routes of the same
+//    length as plain A* between random intersections, and every route runs
+//    unbroken from start to end;
+//  - a snapshot with the hierarchy and landmarks routes the same as the map it
+//    was saved from;
+//  - a text map big enough to be parsed in parallel loads to exactly the same
+//    graph as a single-threaded load (their snapshots are byte for byte equal).
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -pthread -I. tests/RoutingCheck.cpp $(ls *.cpp | grep -v main.cpp) -o routingcheck
+//   ./routingcheck mapdata.txt
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include <vector>
+#include <list>
+#include <string>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iterator>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+static unsigned int failures = 0;
+
+static void fail(const string& message)
+{
+	cout << "FAIL: " << message << endl;
+	failures++;
+}
+
+  // route with algorithm; false (and a failure) if the route doesn't join start to end
+static bool route(const PointToPointRouter& router, const GeoCoord& start, const GeoCoord& end, RouteAlgorithm algorithm,
+                  DeliveryResult& result, double& miles)
+{
+	list<StreetSegment> segments;
+	miles = 0;
+	result = router.generatePointToPointRoute(start, end, segments, miles, algorithm);
+	if (result != DELIVERY_SUCCESS) {
+		return true;
+	}
+	GeoCoord at = start;
+	for (const StreetSegment& s : segments) {
+		if (s.start != at) {
+			fail("route from " + start.latitudeText + " " + start.longitudeText + " is broken");
+			return false;
+		}
+		at = s.end;
+	}
+	if (at != end) {
+		fail("route from " + start.latitudeText + " " + start.longitudeText + " ends in the wrong place");
+		return false;
+	}
+	return true;
+}
+
+  // every algorithm against plain A* on the same random pairs
+static void checkAlgorithms(const StreetMap& map, const StreetMap* snapshotMap, unsigned int numPairs)
+{
+	const RouteAlgorithm algorithms[] = { ROUTE_BIDIRECTIONAL_ASTAR, ROUTE_ALT, ROUTE_CONTRACTION_HIERARCHY };
+	const char* names[] = { "bidirectional A*", "ALT", "contraction hierarchy" };
+	const StreetGraph& g = map.graph();
+	PointToPointRouter router(&map);
+	mt19937 random(42);
+	uniform_int_distribution<unsigned int> node(0, g.numNodes() - 1);
+	for (unsigned int p = 0; p < numPairs; p++) {
+		GeoCoord start = g.coord(node(random)), end = g.coord(node(random));
+		DeliveryResult expected;
+		double expectedMiles;
+		route(router, start, end, ROUTE_ASTAR, expected, expectedMiles);
+		for (unsigned int a = 0; a < 3; a++) {
+			DeliveryResult result;
+			double miles;
+			if (route(router, start, end, algorithms[a], result, miles) &&
+			    (result != expected || fabs(miles - expectedMiles) > 1e-9)) {
+				ostringstream message;
+				message.precision(12);
+				message << names[a] << " found " << miles << " miles where A* found " << expectedMiles;
+				fail(message.str());
+			}
+		}
+		if (snapshotMap != nullptr) {
+			PointToPointRouter snapshotRouter(snapshotMap);
+			DeliveryResult result;
+			double miles;
+			if (route(snapshotRouter, start, end, ROUTE_CONTRACTION_HIERARCHY, result, miles) &&
+			    (result != expected || fabs(miles - expectedMiles) > 1e-9)) {
+				fail("the snapshot's hierarchy disagrees with A*");
+			}
+		}
+	}
+}
+
+static bool readFile(const string& fileName, string& contents)
+{
+	ifstream in(fileName, ios::binary);
+	if (!in) {
+		return false;
+	}
+	contents.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	return true;
+}
+
+  // copies of mapText, each moved a degree further north, until the text is at
+  // least minSize bytes; latitudes are the first and third numbers of a segment line
+static string tiledMap(const string& mapText, size_t minSize)
+{
+	string out;
+	for (int copy = 0; out.size() < minSize; copy++) {
+		istringstream in(mapText);
+		string name, count;
+		while (getline(in, name) && getline(in, count)) {
+			out += name + "\n" + count + "\n";
+			for (int k = atoi(count.c_str()); k > 0; k--) {
+				string lat1, lon1, lat2, lon2;
+				in >> lat1 >> lon1 >> lat2 >> lon2;
+				in.ignore(10000, '\n');
+				out += to_string(atoi(lat1.c_str()) + copy) + lat1.substr(lat1.find('.')) + " " + lon1 + " " +
+				       to_string(atoi(lat2.c_str()) + copy) + lat2.substr(lat2.find('.')) + " " + lon2 + "\n";
+			}
+		}
+	}
+	return out;
+}
+
+static void checkParallelLoad(const string& mapText)
+{
+	const string textFile = "routingcheck_map.txt";
+	const string serialFile = "routingcheck_serial.snapshot";
+	const string parallelFile = "routingcheck_parallel.snapshot";
+	{
+		ofstream out(textFile, ios::binary);
+		out << tiledMap(mapText, 20 << 20); // the loader gives each thread at least 4 MB
+	}
+	StreetMap serial, parallel;
+	string serialBytes, parallelBytes;
+	if (!serial.load(textFile, 1) || !parallel.load(textFile, 4)) {
+		fail("the tiled map didn't load");
+	}
+	else if (!serial.saveSnapshot(serialFile) || !parallel.saveSnapshot(parallelFile) ||
+	         !readFile(serialFile, serialBytes) || !readFile(parallelFile, parallelBytes)) {
+		fail("couldn't write the loaded maps' snapshots");
+	}
+	else if (serialBytes != parallelBytes) {
+		fail("a parallel load built a different graph than a serial one");
+	}
+	remove(textFile.c_str());
+	remove(serialFile.c_str());
+	remove(parallelFile.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+	string mapFile = (argc > 1) ? argv[1] : "mapdata.txt";
+	string mapText;
+	StreetMap map;
+	if (!readFile(mapFile, mapText) || !map.load(mapFile)) {
+		cout << "Unable to load map data file " << mapFile << endl;
+		return 1;
+	}
+	map.buildContractionHierarchy();
+	map.buildLandmarks(8);
+
+	const string snapshotFile = "routingcheck.snapshot";
+	StreetMap snapshotMap;
+	if (!map.saveSnapshot(snapshotFile) || !snapshotMap.load(snapshotFile)) {
+		fail("the map's snapshot didn't load");
+	}
+	checkAlgorithms(map, &snapshotMap, 500);
+	remove(snapshotFile.c_str());
+
+	checkParallelLoad(mapText);
+
+	if (failures != 0) {
+		cout << failures << " check(s) failed" << endl;
+		return 1;
+	}
+	cout << "All routing and loading checks passed" << endl;
+	return 0;
+}
@@ -0,0 +1,82 @@
+#!/bin/sh
+# Sends the planning server a scripted mix of good and bad request lines on
+# standard input and checks that each gets the expected answer and that the
+# server answers them all and exits cleanly rather than dying on a bad one.
+#
+# Build and run from the repository root:
+#   g++ -O2 -std=c++11 -pthread *.cpp -o planner
+#   sh tests/ServerRoundTrip.sh ./planner mapdata.txt
+
+planner=${1:-./planner}
+map=${2:-mapdata.txt}
+depot='["34.0625329", "-118.4470263"]'
+stop='{"item": "Chicken tenders", "lat": "34.0712323", "lon": "-118.4505969"}'
+
+output=$("$planner" -serve "$map" 2>/dev/null <<EOF
+{"id": 1, "depot": $depot, "stops": [$stop]}
+{"id": 2, "depot": ["abc", "def"], "stops": []}
+{"id": 3, "depot": $depot, "stops": [{"item": "x", "lat": "1e999", "lon": "-118.45"}]}
+{"id": 4, "depot": $depot, "stops": [{"item": "x", "lat": "", "lon": "-118.45"}]}
+{"id": 5, "depot": $depot, "stops": [$stop], "options": {"numThreads": -1}}
+{"id": 6, "depot": $depot, "stops": [$stop], "options": {"numChains": 0}}
+{"id": 7, "depot": $depot, "stops": [$stop], "options": {"numChains": 2.5}}
+{"id": 8, "depot": $depot, "stops": [$stop], "options": {"numThreads": 100000, "numChains": 100000}}
+{"id": 9, "depot": $depot, "stops": [$stop], "options": {"seed": -3}}
+{"id": 10, "depot": $depot, "stops": [$stop], "options": {"timeLimit": -1}}
+{"id": 11, "depot": $depot, "stops": [$stop], "options": {"timeLimit": 0.5, "seed": 7, "method": "local"}}
+{"id": 12, "depot": ["10.0", "10.0"], "stops": [$stop]}
+not json at all
+{"id": 13, "command": "stats"}
+{"id": 14, "depot": ["34.06253", "-118.44702"], "stops": [$stop], "options": {"maxSnapMiles": 0}}
+{"id": 15, "depot": $depot, "stops": [$stop], "options": {"maxSnapMiles": -1}}
+EOF
+)
+status=$?
+
+failures=0
+expect()
+{
+    if ! printf '%s\n' "$output" | grep -q "^{\"id\": $1, \"status\": \"$2\""; then
+        echo "FAIL: request $1 should have status $2"
+        failures=$((failures + 1))
+    fi
+}
+expectError()
+{
+    expect "$1" error
+    if ! printf '%s\n' "$output" | grep "^{\"id\": $1," | grep -q "\"error\": \"$2\""; then
+        echo "FAIL: request $1 should fail with $2"
+        failures=$((failures + 1))
+    fi
+}
+
+if [ $status -ne 0 ]; then
+    echo "FAIL: server exited with status $status"
+    failures=$((failures + 1))
+fi
+if [ "$(printf '%s\n' "$output" | wc -l)" -ne 16 ]; then
+    echo "FAIL: expected 16 result lines"
+    failures=$((failures + 1))
+fi
+expect 1 ok
+expectError 2 BAD_REQUEST
+expectError 3 BAD_REQUEST
+expectError 4 BAD_REQUEST
+expectError 5 BAD_REQUEST
+expectError 6 BAD_REQUEST
+expectError 7 BAD_REQUEST
+expect 8 ok
+expectError 9 BAD_REQUEST
+expectError 10 BAD_REQUEST
+expect 11 ok
+expectError 12 BAD_COORD
+expectError null BAD_REQUEST
+expect 13 ok
+expectError 14 BAD_COORD
+expectError 15 BAD_REQUEST
+
+if [ $failures -ne 0 ]; then
+    echo "$failures check(s) failed"
+    exit 1
+fi
+echo "All server round-trip checks passed"
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Builds the planner and the check programs into a scratch directory and runs
+# every check against mapdata.txt. Run from the repository root:
+#   sh tests/run_tests.sh [build directory]
+# The exit status is 1 if anything fails to build or any check fails.
+
+build=${1:-_test_build}
+mkdir -p "$build" || exit 1
+sources=$(ls *.cpp | grep -v '^main\.cpp$')
+flags="-O2 -std=c++11 -Wall -pthread -I."
+
+echo "Building..."
+g++ $flags *.cpp -o "$build/planner" &&
+g++ $flags tests/HeldKarpCheck.cpp $sources -o "$build/heldkarpcheck" &&
+g++ $flags tests/RoutingCheck.cpp $sources -o "$build/routingcheck" &&
+g++ $flags tests/OptimizerCheck.cpp $sources -o "$build/optimizercheck" || exit 1
+
+failed=0
+for check in "$build/heldkarpcheck" "$build/optimizercheck" "$build/routingcheck mapdata.txt" "sh tests/ServerRoundTrip.sh $build/planner mapdata.txt"; do
+    echo "== $check"
+    $check || failed=1
+done
+exit $failed